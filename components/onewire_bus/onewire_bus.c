@@ -12,6 +12,7 @@ static const char *TAG = "onewire";
 
 struct onewire_rom_search_context_t {
     onewire_bus_handle_t bus_handle;
+    uint8_t search_command; /*!< SEARCH ROM, or ALARM SEARCH to find only devices with alarm flag set */
 
     uint8_t last_device_flag;
     uint16_t last_discrepancy;
@@ -61,6 +62,7 @@ esp_err_t onewire_rom_search_context_create(onewire_bus_handle_t handle, onewire
     }
 
     context->bus_handle = handle;
+    context->search_command = ONEWIRE_CMD_SEARCH_ROM;
     *context_out = context;
 
     return ESP_OK;
@@ -75,6 +77,17 @@ esp_err_t onewire_rom_search_context_delete(onewire_rom_search_context_handler_t
     return ESP_OK;
 }
 
+esp_err_t onewire_rom_search_context_set_command(onewire_rom_search_context_handler_t context, uint8_t search_command)
+{
+    ESP_RETURN_ON_FALSE(context, ESP_ERR_INVALID_ARG, TAG, "invalid context handler pointer");
+    ESP_RETURN_ON_FALSE(search_command == ONEWIRE_CMD_SEARCH_ROM || search_command == ONEWIRE_CMD_ALARM_SEARCH_ROM,
+                        ESP_ERR_INVALID_ARG, TAG, "invalid search command");
+
+    context->search_command = search_command;
+
+    return ESP_OK;
+}
+
 esp_err_t onewire_rom_search(onewire_rom_search_context_handler_t context)
 {
     ESP_RETURN_ON_FALSE(context, ESP_ERR_INVALID_ARG, TAG, "invalid context handler pointer");
@@ -82,50 +95,41 @@ esp_err_t onewire_rom_search(onewire_rom_search_context_handler_t context)
     uint8_t last_zero = 0;
 
     if (!context->last_device_flag) {
-        if (onewire_bus_reset(context->bus_handle) != ESP_OK) { // no device present
+        // reset bus and send rom search command in one transaction, then start search algorithm
+        if (onewire_bus_transact(context->bus_handle, &context->search_command, 1, NULL, 0, NULL) != ESP_OK) { // no device present
             return ESP_ERR_NOT_FOUND;
         }
 
-        // send rom search command and start search algorithm
-        ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(context->bus_handle, (uint8_t[]){ONEWIRE_CMD_SEARCH_ROM}, 1),
-                            TAG, "error while sending search rom command");
-
         for (uint16_t rom_bit_index = 0; rom_bit_index < 64; rom_bit_index ++) {
             uint8_t rom_byte_index = rom_bit_index / 8;
             uint8_t rom_bit_mask = 1 << (rom_bit_index % 8); // calculate byte index and bit mask in advance for convenience
 
-            uint8_t rom_bit, rom_bit_complement;
-            ESP_RETURN_ON_ERROR(onewire_bus_read_bit(context->bus_handle, &rom_bit), TAG, "error while reading rom bit"); // write 1 bit to read from the bus
-            ESP_RETURN_ON_ERROR(onewire_bus_read_bit(context->bus_handle, &rom_bit_complement),
-                                TAG, "error while reading rom bit"); // read a bit and its complement
+            // direction to take if there are both 0s and 1s in the current bit position of the participating ROM numbers
+            uint8_t discrepancy_direction;
+            if (rom_bit_index < context->last_discrepancy) { // current id bit is before the last discrepancy bit
+                discrepancy_direction = (context->rom_number[rom_byte_index] & rom_bit_mask) ? 0x01 : 0x00; // follow previous way
+            } else {
+                discrepancy_direction = (rom_bit_index == context->last_discrepancy) ? 0x01 : 0x00; // search for 0 bit first
+            }
 
-            uint8_t search_direction;
-            if (rom_bit && rom_bit_complement) { // No devices participating in search.
-                ESP_LOGE(TAG, "no devices participating in search");
+            // read a bit and its complement, then write the search direction
+            uint8_t rom_bit, rom_bit_complement, search_direction;
+            esp_err_t ret = onewire_bus_search_triplet(context->bus_handle, discrepancy_direction,
+                                                       &rom_bit, &rom_bit_complement, &search_direction);
+            if (ret == ESP_ERR_NOT_FOUND) { // No devices participating in search, e.g. no device in alarm state.
+                ESP_LOGD(TAG, "no devices participating in search");
                 return ESP_ERR_NOT_FOUND;
+            }
+            ESP_RETURN_ON_ERROR(ret, TAG, "error while searching rom bit");
+
+            if (!rom_bit && !rom_bit_complement && search_direction == 0) { // record zero's position in last zero
+                last_zero = rom_bit_index;
+            }
+
+            if (search_direction == 1) { // set corrsponding rom bit by serach direction
+                context->rom_number[rom_byte_index] |= rom_bit_mask;
             } else {
-                if (rom_bit != rom_bit_complement) { // There are only 0s or 1s in the bit of the participating ROM numbers.
-                    search_direction = rom_bit;  // just go ahead
-                } else { // There are both 0s and 1s in the current bit position of the participating ROM numbers. This is a discrepancy.
-                    if (rom_bit_index < context->last_discrepancy) { // current id bit is before the last discrepancy bit
-                        search_direction = (context->rom_number[rom_byte_index] & rom_bit_mask) ? 0x01 : 0x00; // follow previous way
-                    } else {
-                        search_direction = (rom_bit_index == context->last_discrepancy) ? 0x01 : 0x00; // search for 0 bit first
-                    }
-
-                    if (search_direction == 0) { // record zero's position in last zero
-                        last_zero = rom_bit_index;
-                    }
-                }
-
-                if (search_direction == 1) { // set corrsponding rom bit by serach direction
-                    context->rom_number[rom_byte_index] |= rom_bit_mask;
-                } else {
-                    context->rom_number[rom_byte_index] &= ~rom_bit_mask;
-                }
-
-                ESP_RETURN_ON_ERROR(onewire_bus_write_bit(context->bus_handle, search_direction),
-                                    TAG, "error while writing direction bit"); // set search direction
+                context->rom_number[rom_byte_index] &= ~rom_bit_mask;
             }
         }
     } else {
@@ -5,8 +5,13 @@
  */
 #pragma once
 
+#include "sdkconfig.h"
 #include "esp_err.h"
+#include "onewire_bus_api.h"
+#if !CONFIG_IDF_TARGET_LINUX
 #include "onewire_bus_rmt.h"
+#endif
+#include "onewire_bus_sim.h"
 
 #define ONEWIRE_CMD_SEARCH_ROM 0xF0
 #define ONEWIRE_CMD_READ_ROM 0x33
@@ -53,13 +58,27 @@ esp_err_t onewire_rom_search_context_create(onewire_bus_handle_t handle, onewire
  */
 esp_err_t onewire_rom_search_context_delete(onewire_rom_search_context_handler_t context);
 
+/**
+ * @brief Set ROM command used by 1-wire ROM search algorithm
+ *
+ * @note ONEWIRE_CMD_ALARM_SEARCH_ROM finds only devices with their alarm flag set, e.g. DS18B20 whose temperature
+ *       is out of TH/TL range after the last conversion. Set it before the first onewire_rom_search().
+ *
+ * @param[in] context Context for ROM search algorithm
+ * @param[in] search_command ONEWIRE_CMD_SEARCH_ROM (default) or ONEWIRE_CMD_ALARM_SEARCH_ROM
+ * @return
+ *         - ESP_OK                Search command is set.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ */
+esp_err_t onewire_rom_search_context_set_command(onewire_rom_search_context_handler_t context, uint8_t search_command);
+
 /**
  * @brief Search next device on 1-wire bus
  *
  * @param[in] context Context for ROM search algorithm
  * @return
  *         - ESP_OK                Successfully found a device
- *         - ESP_ERR_NOT_FOUND     There are no device on the bus
+ *         - ESP_ERR_NOT_FOUND     There are no device on the bus, or no device in alarm state for alarm search
  *         - ESP_ERR_INVALID_CRC   Bad CRC value of found device
  *         - ESP_FAIL              Reached last device on the bus, search algorighm finishes
  */
@@ -0,0 +1,173 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_check.h"
+#include "onewire_bus.h"
+#include "onewire_bus_interface.h"
+
+static const char *TAG = "onewire_bus";
+
+/**
+ * @brief Stack size and priority of the task serving asynchronous requests of a 1-wire bus
+ *
+ */
+#define ONEWIRE_WORKER_TASK_STACK_SIZE 3072 // room for error logs of the backend
+#define ONEWIRE_WORKER_TASK_PRIORITY 5
+
+static void onewire_bus_worker_task(void *params)
+{
+    onewire_bus_handle_t handle = (onewire_bus_handle_t)params;
+    onewire_bus_request_t *request;
+
+    // serve requests one by one until a NULL request asks the task to exit
+    while (xQueueReceive(handle->request_queue, &request, portMAX_DELAY) == pdPASS && request) {
+        esp_err_t result = onewire_bus_transact(handle, request->tx_data, request->tx_data_size,
+                                                request->rx_data, request->rx_data_size, &request->rx_crc_valid);
+        if (request->on_done) {
+            request->on_done(handle, request, result);
+        }
+    }
+
+    xTaskNotifyGive(handle->deleting_task);
+    vTaskDelete(NULL);
+}
+
+esp_err_t onewire_bus_init_requests(struct onewire_bus_t *bus, uint8_t request_queue_depth)
+{
+    ESP_RETURN_ON_FALSE(bus, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+
+    if (request_queue_depth == 0) {
+        return ESP_OK;
+    }
+
+    bus->request_queue = xQueueCreate(request_queue_depth, sizeof(onewire_bus_request_t *));
+    ESP_RETURN_ON_FALSE(bus->request_queue, ESP_ERR_NO_MEM, TAG, "request queue creation failed");
+
+    ESP_RETURN_ON_FALSE(xTaskCreate(onewire_bus_worker_task, "onewire_worker", ONEWIRE_WORKER_TASK_STACK_SIZE, bus,
+                                    ONEWIRE_WORKER_TASK_PRIORITY, &bus->worker_task) == pdPASS,
+                        ESP_ERR_NO_MEM, TAG, "worker task creation failed");
+
+    return ESP_OK;
+}
+
+esp_err_t onewire_del_bus(onewire_bus_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+
+    if (handle->worker_task) { // let the worker task finish pending requests and exit
+        onewire_bus_request_t *exit_request = NULL;
+        handle->deleting_task = xTaskGetCurrentTaskHandle();
+        xQueueSend(handle->request_queue, &exit_request, portMAX_DELAY);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    }
+    if (handle->request_queue) {
+        vQueueDelete(handle->request_queue);
+    }
+
+    return handle->del(handle);
+}
+
+esp_err_t onewire_bus_reset(onewire_bus_handle_t handle)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+
+    return handle->reset(handle);
+}
+
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t handle, const uint8_t *tx_data, uint8_t tx_data_size)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(tx_data && tx_data_size != 0, ESP_ERR_INVALID_ARG, TAG, "invalid tx buffer or buffer size");
+
+    return handle->write_bytes(handle, tx_data, tx_data_size);
+}
+
+esp_err_t onewire_bus_read_bytes(onewire_bus_handle_t handle, uint8_t *rx_data, size_t rx_data_size)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(rx_data && rx_data_size != 0, ESP_ERR_INVALID_ARG, TAG, "invalid rx buffer or buffer size");
+
+    return handle->read_bytes(handle, rx_data, rx_data_size);
+}
+
+esp_err_t onewire_bus_write_bit(onewire_bus_handle_t handle, uint8_t tx_bit)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+
+    return handle->write_bit(handle, tx_bit);
+}
+
+esp_err_t onewire_bus_read_bit(onewire_bus_handle_t handle, uint8_t *rx_bit)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(rx_bit, ESP_ERR_INVALID_ARG, TAG, "invalid rx_bit pointer");
+
+    return handle->read_bit(handle, rx_bit);
+}
+
+esp_err_t onewire_bus_transact(onewire_bus_handle_t handle, const uint8_t *tx_data, uint8_t tx_data_size,
+                               uint8_t *rx_data, size_t rx_data_size, bool *rx_crc_valid)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(tx_data || tx_data_size == 0, ESP_ERR_INVALID_ARG, TAG, "invalid tx buffer");
+    ESP_RETURN_ON_FALSE(rx_data || rx_data_size == 0, ESP_ERR_INVALID_ARG, TAG, "invalid rx buffer");
+
+    if (handle->transact) {
+        return handle->transact(handle, tx_data, tx_data_size, rx_data, rx_data_size, rx_crc_valid);
+    }
+
+    // backend without native transaction, run it step by step
+    ESP_RETURN_ON_ERROR(handle->reset(handle), TAG, "error while resetting bus");
+    if (tx_data_size) {
+        ESP_RETURN_ON_ERROR(handle->write_bytes(handle, tx_data, tx_data_size), TAG, "error while writing bytes");
+    }
+    if (rx_data_size) {
+        ESP_RETURN_ON_ERROR(handle->read_bytes(handle, rx_data, rx_data_size), TAG, "error while reading bytes");
+    }
+    if (rx_crc_valid) {
+        *rx_crc_valid = onewire_check_crc8(rx_data, rx_data_size) == 0; // CRC of data followed by its CRC byte is 0
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t onewire_bus_search_triplet(onewire_bus_handle_t handle, uint8_t direction,
+                                     uint8_t *id_bit, uint8_t *cmp_id_bit, uint8_t *taken_direction)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(id_bit && cmp_id_bit && taken_direction, ESP_ERR_INVALID_ARG, TAG, "invalid triplet pointer");
+
+    if (handle->search_triplet) {
+        return handle->search_triplet(handle, direction, id_bit, cmp_id_bit, taken_direction);
+    }
+
+    // backend without native triplet, run it bit by bit
+    ESP_RETURN_ON_ERROR(handle->read_bit(handle, id_bit), TAG, "error while reading rom bit");
+    ESP_RETURN_ON_ERROR(handle->read_bit(handle, cmp_id_bit), TAG, "error while reading rom bit complement");
+
+    if (*id_bit && *cmp_id_bit) { // no devices participating in search, nothing to write
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *taken_direction = (*id_bit != *cmp_id_bit) ? *id_bit : (direction ? 0x01 : 0x00);
+
+    return handle->write_bit(handle, *taken_direction);
+}
+
+esp_err_t onewire_bus_submit(onewire_bus_handle_t handle, onewire_bus_request_t *request)
+{
+    ESP_RETURN_ON_FALSE(handle && request, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle or request");
+    ESP_RETURN_ON_FALSE(handle->request_queue, ESP_ERR_INVALID_STATE, TAG, "1-wire bus has no request queue");
+
+    // never block the caller, a full queue is reported instead
+    ESP_RETURN_ON_FALSE(xQueueSend(handle->request_queue, &request, 0) == pdPASS, ESP_ERR_NO_MEM,
+                        TAG, "1-wire request queue is full");
+
+    return ESP_OK;
+}
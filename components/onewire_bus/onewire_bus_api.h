@@ -0,0 +1,179 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+/**
+ * @brief Type of 1-wire bus handle
+ *
+ */
+typedef struct onewire_bus_t *onewire_bus_handle_t;
+
+/**
+ * @brief Type of asynchronous 1-wire request
+ *
+ */
+typedef struct onewire_bus_request_t onewire_bus_request_t;
+
+/**
+ * @brief Callback invoked when an asynchronous request completes
+ *
+ * @note The callback runs in the context of the bus worker task, keep it short (e.g. give a task notification).
+ *
+ * @param[in] handle 1-wire bus handle the request was submitted to
+ * @param[in] request Completed request
+ * @param[in] result Result of the transaction, same as returned by onewire_bus_transact()
+ */
+typedef void (*onewire_bus_request_done_cb_t)(onewire_bus_handle_t handle, onewire_bus_request_t *request, esp_err_t result);
+
+/**
+ * @brief Asynchronous 1-wire request, executed as one onewire_bus_transact()
+ *
+ */
+struct onewire_bus_request_t {
+    const uint8_t *tx_data; /*!< data to be sent after reset pulse */
+    uint8_t tx_data_size; /*!< number of data to be sent */
+    uint8_t *rx_data; /*!< received data */
+    size_t rx_data_size; /*!< number of data to be received */
+    bool rx_crc_valid; /*!< set on completion, whether Dallas CRC of received data (including CRC byte) is valid */
+    onewire_bus_request_done_cb_t on_done; /*!< completion callback, can be NULL */
+    void *user_ctx; /*!< user context, not used by the driver */
+};
+
+/**
+ * @brief Delete existing 1-wire bus
+ *
+ * @param[in] handle 1-wire bus handle to be deleted
+ * @return
+ *         - ESP_OK                1-wire bus is deleted successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ */
+esp_err_t onewire_del_bus(onewire_bus_handle_t handle);
+
+/**
+ * @brief Send reset pulse on 1-wire bus, and detect if there are devices on the bus
+ *
+ * @param[in] handle 1-wire bus handle
+ * @return
+ *         - ESP_OK                There are devices present on 1-wire bus.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ */
+esp_err_t onewire_bus_reset(onewire_bus_handle_t handle);
+
+/**
+ * @brief Write bytes to 1-wire bus, this is a blocking function
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[in] tx_data pointer to data to be sent
+ * @param[in] tx_data_count number of data to be sent
+ * @return
+ *         - ESP_OK                Write bytes to 1-wire bus successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ */
+esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t handle, const uint8_t *tx_data, uint8_t tx_data_size);
+
+/**
+ * @brief Read bytes from 1-wire bus
+ *
+ * @note While receiving data, the backend sends 0xFF to generate read pulse,
+ *       at the same time, it records weather the bus is pulled down by device.
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[out] rx_data pointer to received data
+ * @param[in] rx_data_count number of received data
+ * @return
+ *         - ESP_OK                Read bytes from 1-wire bus successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ */
+esp_err_t onewire_bus_read_bytes(onewire_bus_handle_t handle, uint8_t *rx_data, size_t rx_data_size);
+
+/**
+ * @brief Write a bit to 1-wire bus, this is a blocking function
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[in] tx_bit bit to transmit, 0 for zero bit, other for one bit
+ * @return
+ *         - ESP_OK                Write bit to 1-wire bus successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ */
+esp_err_t onewire_bus_write_bit(onewire_bus_handle_t handle, uint8_t tx_bit);
+
+/**
+ * @brief Read a bit from 1-wire bus
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[out] rx_bit received bit, 0 for zero bit, 1 for one bit
+ * @return
+ *         - ESP_OK                Read bit from 1-wire bus successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ */
+esp_err_t onewire_bus_read_bit(onewire_bus_handle_t handle, uint8_t *rx_bit);
+
+/**
+ * @brief Reset 1-wire bus, write bytes and read bytes back in one transaction
+ *
+ * @note The RMT backend encodes the reset pulse, the written bits and the read slots as one symbol stream,
+ *       so the calling task is woken up only once when the whole transaction completes.
+ *       Received data is decoded and its CRC is calculated in the receive done callback,
+ *       which wakes the calling task with a task notification. Blocking functions of this backend use
+ *       the notification value of the calling task, so it must not be used for anything else meanwhile.
+ *       Backends without native support run it as reset, write bytes and read bytes.
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[in] tx_data pointer to data to be sent after reset pulse, NULL if tx_data_size is 0
+ * @param[in] tx_data_size number of data to be sent
+ * @param[out] rx_data pointer to received data, NULL if rx_data_size is 0
+ * @param[in] rx_data_size number of data to be received
+ * @param[out] rx_crc_valid whether Dallas CRC of received data (last byte being the CRC) is valid, can be NULL
+ * @return
+ *         - ESP_OK                Transaction finished successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ *         - ESP_ERR_TIMEOUT       Transaction did not finish before the deadline derived from its length.
+ */
+esp_err_t onewire_bus_transact(onewire_bus_handle_t handle, const uint8_t *tx_data, uint8_t tx_data_size,
+                               uint8_t *rx_data, size_t rx_data_size, bool *rx_crc_valid);
+
+/**
+ * @brief Read a ROM bit and its complement, then write the search direction bit, as used by ROM search
+ *
+ * @note The RMT backend sends and receives the two read slots as one RMT transaction, and writes the direction bit
+ *       right after they are decoded. Backends without native support run it as two read bits and one write bit.
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[in] direction direction bit to write if participating devices disagree on this bit
+ * @param[out] id_bit ROM bit read from the bus
+ * @param[out] cmp_id_bit complement of ROM bit read from the bus
+ * @param[out] taken_direction direction bit written to the bus
+ * @return
+ *         - ESP_OK                Triplet finished successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     No devices participating in search, no direction bit written.
+ *         - ESP_ERR_TIMEOUT       Read slots did not finish in time.
+ */
+esp_err_t onewire_bus_search_triplet(onewire_bus_handle_t handle, uint8_t direction,
+                                     uint8_t *id_bit, uint8_t *cmp_id_bit, uint8_t *taken_direction);
+
+/**
+ * @brief Submit an asynchronous request to 1-wire bus, this is a non-blocking function
+ *
+ * @note Requests are executed in submission order by the bus worker task, which is created when
+ *       request_queue_depth is not 0. The request and its buffers must stay valid until on_done is called.
+ *       Blocking functions must not be called on the same bus while asynchronous requests are pending.
+ *
+ * @param[in] handle 1-wire bus handle
+ * @param[in] request Request to be executed
+ * @return
+ *         - ESP_OK                Request is queued.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_INVALID_STATE 1-wire bus was installed without request queue.
+ *         - ESP_ERR_NO_MEM        Request queue is full.
+ */
+esp_err_t onewire_bus_submit(onewire_bus_handle_t handle, onewire_bus_request_t *request);
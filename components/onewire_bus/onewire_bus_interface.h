@@ -0,0 +1,85 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "onewire_bus_api.h"
+
+/**
+ * @brief 1-wire bus backend interface, implemented by each bus backend (e.g. RMT or simulated)
+ *
+ * @note A backend embeds this structure as the first member of its own bus object,
+ *       the onewire_bus_* functions dispatch to the backend through it.
+ *
+ */
+struct onewire_bus_t {
+    /**
+     * @brief Send reset pulse and detect presence pulse, see onewire_bus_reset()
+     */
+    esp_err_t (*reset)(struct onewire_bus_t *bus);
+
+    /**
+     * @brief Write bytes, see onewire_bus_write_bytes()
+     */
+    esp_err_t (*write_bytes)(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size);
+
+    /**
+     * @brief Read bytes, see onewire_bus_read_bytes()
+     */
+    esp_err_t (*read_bytes)(struct onewire_bus_t *bus, uint8_t *rx_data, size_t rx_data_size);
+
+    /**
+     * @brief Write a bit, see onewire_bus_write_bit()
+     */
+    esp_err_t (*write_bit)(struct onewire_bus_t *bus, uint8_t tx_bit);
+
+    /**
+     * @brief Read a bit, see onewire_bus_read_bit()
+     */
+    esp_err_t (*read_bit)(struct onewire_bus_t *bus, uint8_t *rx_bit);
+
+    /**
+     * @brief Reset, write and read in one transaction, see onewire_bus_transact()
+     *
+     * @note Optional, NULL if the backend has no faster way than reset, write bytes and read bytes
+     */
+    esp_err_t (*transact)(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size,
+                          uint8_t *rx_data, size_t rx_data_size, bool *rx_crc_valid);
+
+    /**
+     * @brief Read a ROM bit and its complement, then write the search direction, see onewire_bus_search_triplet()
+     *
+     * @note Optional, NULL if the backend has no faster way than two read bits and one write bit
+     */
+    esp_err_t (*search_triplet)(struct onewire_bus_t *bus, uint8_t direction,
+                                uint8_t *id_bit, uint8_t *cmp_id_bit, uint8_t *taken_direction);
+
+    /**
+     * @brief Free backend resources, see onewire_del_bus()
+     */
+    esp_err_t (*del)(struct onewire_bus_t *bus);
+
+    QueueHandle_t request_queue; /*!< pending asynchronous requests, managed by the generic layer */
+    TaskHandle_t worker_task; /*!< task serving asynchronous requests, managed by the generic layer */
+    TaskHandle_t deleting_task; /*!< task waiting for the worker task to exit, managed by the generic layer */
+};
+
+/**
+ * @brief Create request queue and worker task serving onewire_bus_submit(), called by backends on bus creation
+ *
+ * @param[in] bus 1-wire bus, with backend functions set
+ * @param[in] request_queue_depth number of pending asynchronous requests, 0 to not support onewire_bus_submit()
+ * @return
+ *         - ESP_OK                Asynchronous requests are supported, or not requested.
+ *         - ESP_ERR_NO_MEM        Memory allocation failed.
+ */
+esp_err_t onewire_bus_init_requests(struct onewire_bus_t *bus, uint8_t request_queue_depth);
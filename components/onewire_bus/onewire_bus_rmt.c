@@ -12,7 +12,10 @@
 #include "driver/rmt_rx.h"
 #include "driver/rmt_types.h"
 #include "driver/rmt_encoder.h"
+#include "soc/soc_caps.h"
+#include "onewire_bus.h"
 #include "onewire_bus_rmt.h"
+#include "onewire_bus_interface.h"
 
 static const char *TAG = "onewire_rmt";
 
@@ -30,6 +33,8 @@ static const char *TAG = "onewire_rmt";
 #define ONEWIRE_RESET_WAIT_DURATION 200 // how long should master wait for device to show its presence
 #define ONEWIRE_RESET_PRESENSE_WAIT_DURATION_MIN 15 // minimum duration for master to wait device to show its presence
 #define ONEWIRE_RESET_PRESENSE_DURATION_MIN 60 // minimum duration for master to recognize device as present
+#define ONEWIRE_RESET_PRESENSE_DURATION_MAX 300 // maximum duration for master to recognize device as present
+#define ONEWIRE_RESET_RECOVERY_DURATION 480 // how long should master wait after reset pulse before the first slot of a transaction
 
 #define ONEWIRE_SLOT_START_DURATION 2 // bit start pulse duration
 #define ONEWIRE_SLOT_BIT_DURATION 60 // duration for each bit to transmit
@@ -37,6 +42,20 @@ static const char *TAG = "onewire_rmt";
 #define ONEWIRE_SLOT_RECOVERY_DURATION 2  // recovery time between each bit, should be longer in parasite power mode
 #define ONEWIRE_SLOT_BIT_SAMPLE_TIME 15 // how long after bit start pulse should the master sample from the bus
 
+/**
+ * @brief Margin added to the expected duration of a bus operation before it is considered timed out, in ms
+ *
+ */
+#define ONEWIRE_RMT_TIMEOUT_MARGIN_MS 5
+
+/**
+ * @brief RMT memory block, in symbols
+ *
+ * @note Without rx ping-pong (e.g. ESP32) a receive must fit the blocks of the rx channel, so longer transactions
+ *       and reads are split. With ping-pong one block is refilled while the other is received, one is enough.
+ */
+#define ONEWIRE_RMT_MEM_BLOCK_SYMBOLS SOC_RMT_MEM_WORDS_PER_CHANNEL
+
 /*
 Reset Pulse:
 
@@ -100,18 +119,39 @@ Read 0 bit:
           └─────────────────────────────┘
 */
 
-struct onewire_bus_t {
+/**
+ * @brief How rx done callback decodes received symbols
+ *
+ */
+typedef enum {
+    ONEWIRE_RMT_RX_PRESENCE, /*!< check presence pulse after reset pulse */
+    ONEWIRE_RMT_RX_DATA, /*!< decode read slots into bytes */
+    ONEWIRE_RMT_RX_TRANSACTION, /*!< check presence pulse and decode read slots of a compound transaction */
+} onewire_rmt_rx_mode_t;
+
+typedef struct {
+    struct onewire_bus_t base; /*!< backend interface, must be the first member */
+
     rmt_channel_handle_t tx_channel; /*!< rmt tx channel handler */
     rmt_encoder_handle_t tx_bytes_encoder; /*!< used to encode commands and data */
     rmt_encoder_handle_t tx_copy_encoder; /*!< used to encode reset pulse and bits */
 
     rmt_channel_handle_t rx_channel; /*!< rmt rx channel handler */
     rmt_symbol_word_t *rx_symbols; /*!<  hold rmt raw symbols */
+    rmt_symbol_word_t *tx_symbols; /*!< hold rmt raw symbols of a compound transaction */
 
     size_t max_rx_bytes; /*!< buffer size in byte for single receive transaction */
-
-    QueueHandle_t receive_queue;
-};
+    size_t rx_slot_max; /*!< most slots a single receive can hold, whole bytes */
+
+    portMUX_TYPE rx_lock; /*!< protects receive state shared with rx done callback */
+    TaskHandle_t rx_waiting_task; /*!< task waiting for the receive to finish, NULL if nobody waits */
+    onewire_rmt_rx_mode_t rx_mode; /*!< how rx done callback decodes received symbols */
+    size_t rx_slot_num; /*!< number of slots of the transaction being received */
+    uint8_t *rx_data; /*!< caller's buffer to decode received data into */
+    size_t rx_data_size; /*!< number of data to be received */
+    esp_err_t rx_result; /*!< result of decoding, valid when rx_waiting_task is notified */
+    uint8_t rx_crc8; /*!< Dallas CRC of decoded data, valid when rx_waiting_task is notified */
+} onewire_bus_rmt_obj_t;
 
 const static rmt_symbol_word_t onewire_bit0_symbol = {
     .level0 = 0,
@@ -127,6 +167,21 @@ const static rmt_symbol_word_t onewire_bit1_symbol = {
     .duration1 = ONEWIRE_SLOT_BIT_DURATION + ONEWIRE_SLOT_RECOVERY_DURATION
 };
 
+const static rmt_symbol_word_t onewire_read_two_bits_symbols[2] = {
+    {
+        .level0 = 0,
+        .duration0 = ONEWIRE_SLOT_START_DURATION,
+        .level1 = 1,
+        .duration1 = ONEWIRE_SLOT_BIT_DURATION + ONEWIRE_SLOT_RECOVERY_DURATION
+    },
+    {
+        .level0 = 0,
+        .duration0 = ONEWIRE_SLOT_START_DURATION,
+        .level1 = 1,
+        .duration1 = ONEWIRE_SLOT_BIT_DURATION + ONEWIRE_SLOT_RECOVERY_DURATION
+    }
+};
+
 const static rmt_symbol_word_t onewire_reset_pulse_symbol = {
     .level0 = 0,
     .duration0 = ONEWIRE_RESET_PULSE_DURATION,
@@ -134,6 +189,13 @@ const static rmt_symbol_word_t onewire_reset_pulse_symbol = {
     .duration1 = ONEWIRE_RESET_WAIT_DURATION
 };
 
+const static rmt_symbol_word_t onewire_transaction_reset_symbol = {
+    .level0 = 0,
+    .duration0 = ONEWIRE_RESET_PULSE_DURATION,
+    .level1 = 1,
+    .duration1 = ONEWIRE_RESET_RECOVERY_DURATION
+};
+
 const static rmt_transmit_config_t onewire_rmt_tx_config = {
     .loop_count = 0, // no transfer loop
     .flags.eot_level = 1 // onewire bus should be released in IDLE
@@ -144,16 +206,6 @@ const static rmt_receive_config_t onewire_rmt_rx_config = {
     .signal_range_max_ns = (ONEWIRE_RESET_PULSE_DURATION + ONEWIRE_RESET_WAIT_DURATION) * 1000
 };
 
-static bool onewire_rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
-{
-    BaseType_t task_woken = pdFALSE;
-    struct onewire_bus_t *handle = (struct onewire_bus_t *)user_data;
-
-    xQueueSendFromISR(handle->receive_queue, edata, &task_woken);
-
-    return task_woken;
-}
-
 /*
 [0].0 means symbol[0].duration0
 
@@ -201,18 +253,27 @@ static bool onewire_rmt_check_presence_pulse(rmt_symbol_word_t *rmt_symbols, siz
         }
     }
 
-    ESP_LOGE(TAG, "no device present on 1-wire bus");
     return false;
 }
 
-static void onewire_rmt_decode_data(rmt_symbol_word_t *rmt_symbols, size_t symbol_num, uint8_t *decoded_bytes)
+// update Dallas CRC with one bit, LSB first, so CRC can be calculated while bits are decoded
+static inline uint8_t onewire_rmt_crc8_update_bit(uint8_t crc8, uint8_t bit)
+{
+    uint8_t mix = (crc8 ^ bit) & 0x01;
+    crc8 >>= 1;
+    return mix ? crc8 ^ 0x8C : crc8;
+}
+
+static void onewire_rmt_decode_data(rmt_symbol_word_t *rmt_symbols, size_t symbol_num, uint8_t *decoded_bytes, uint8_t *crc8)
 {
     size_t byte_pos = 0, bit_pos = 0;
     for (size_t i = 0; i < symbol_num; i ++) {
         if (rmt_symbols[i].duration0 > ONEWIRE_SLOT_BIT_SAMPLE_TIME) { // 0 bit
             decoded_bytes[byte_pos] &= ~(1 << bit_pos); // LSB first
+            *crc8 = onewire_rmt_crc8_update_bit(*crc8, 0);
         } else { // 1 bit
             decoded_bytes[byte_pos] |= 1 << bit_pos;
+            *crc8 = onewire_rmt_crc8_update_bit(*crc8, 1);
         }
 
         bit_pos ++;
@@ -223,183 +284,249 @@ static void onewire_rmt_decode_data(rmt_symbol_word_t *rmt_symbols, size_t symbo
     }
 }
 
-esp_err_t onewire_new_bus_rmt(onewire_rmt_config_t *config, onewire_bus_handle_t *handle_out)
-{
-    ESP_RETURN_ON_FALSE(config, ESP_ERR_INVALID_ARG, TAG, "invalid config pointer");
-    ESP_RETURN_ON_FALSE(handle_out, ESP_ERR_INVALID_ARG, TAG, "invalid handle pointer");
+/*
+Compound transaction:
 
-    esp_err_t ret = ESP_OK;
+| Reset | Wait | Device   | RESET_RECOVERY | Slot 0 | Slot 1 | ... | Slot N-1 |
+| Pulse |      | Presense | _DURATION      |        |        |     |          |
 
-    struct onewire_bus_t *handle = calloc(1, sizeof(struct onewire_bus_t));
-    ESP_GOTO_ON_FALSE(handle, ESP_ERR_NO_MEM, err, TAG, "memory allocation for 1-wire bus handler failed");
+The first reset after rmt channel init may merge the reset pulse with the low level of the bus, so low periods are
+counted from the end of the transaction: the last N low periods belong to the slots, and the low period before the
+first slot must be the presence pulse.
+*/
 
-    // create rmt bytes encoder to transmit 1-wire commands and data
-    rmt_bytes_encoder_config_t bytes_encoder_config = {
-        .bit0 = onewire_bit0_symbol,
-        .bit1 = onewire_bit1_symbol,
-        .flags.msb_first = 0
-    };
-    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &handle->tx_bytes_encoder),
-                      err, TAG, "create data tx encoder failed");
+// duration of the low period in the given half of the symbol, 0 if that half is high or marks the end of reception
+static inline uint16_t onewire_rmt_low_duration(const rmt_symbol_word_t *symbol, size_t half)
+{
+    if (half == 0) {
+        return symbol->level0 == 0 ? symbol->duration0 : 0;
+    }
+    return symbol->level1 == 0 ? symbol->duration1 : 0;
+}
 
-    // create rmt copy encoder to transmit 1-wire reset pulse or bits
-    rmt_copy_encoder_config_t copy_encoder_config = {};
-    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &handle->tx_copy_encoder),
-                      err, TAG, "create reset pulse tx encoder failed");
+static esp_err_t onewire_rmt_decode_transaction(rmt_symbol_word_t *rmt_symbols, size_t symbol_num, size_t slot_num,
+                                                uint8_t *rx_data, size_t rx_data_size, uint8_t *crc8)
+{
+    // count low periods to find where the presence pulse is, without decoding anything yet
+    size_t low_num = 0;
+    for (size_t i = 0; i < symbol_num; i ++) {
+        low_num += (onewire_rmt_low_duration(&rmt_symbols[i], 0) != 0) + (onewire_rmt_low_duration(&rmt_symbols[i], 1) != 0);
+    }
+    if (low_num < slot_num + 1) {
+        return ESP_ERR_NOT_FOUND;
+    }
 
-    // create rmt rx channel
-    rmt_rx_channel_config_t onewire_rx_channel_cfg = {
-        .clk_src = RMT_CLK_SRC_DEFAULT,
-        .gpio_num = config->gpio_pin,
-#if SOC_RMT_SUPPORT_RX_PINGPONG
-        .mem_block_symbols = 64, // when the chip is ping-pong capable, we can use less rx memory blocks
-#else
-        .mem_block_symbols = config->max_rx_bytes * 8,
-#endif
-        .resolution_hz = ONEWIRE_RMT_RESOLUTION_HZ, // in us
-    };
-    ESP_GOTO_ON_ERROR(rmt_new_rx_channel(&onewire_rx_channel_cfg, &handle->rx_channel),
-                      err, TAG, "create rmt rx channel failed");
-    ESP_LOGI(TAG, "RMT Tx channel created for 1-wire bus");
+    size_t presence_low = low_num - slot_num - 1;
+    size_t rx_first_low = low_num - rx_data_size * 8; // read slots are the last ones of the transaction
 
-    // create rmt tx channel after rx channel
-    rmt_tx_channel_config_t onewire_tx_channel_cfg = {
-        .clk_src = RMT_CLK_SRC_DEFAULT,
-        .gpio_num = config->gpio_pin,
-        .mem_block_symbols = 64, // ping-pong is always avaliable on tx channel, save hardware memory blocks
-        .resolution_hz = ONEWIRE_RMT_RESOLUTION_HZ, // in us
-        .trans_queue_depth = 4,
-        .flags.io_loop_back = true, // make tx channel coexist with rx channel on the same gpio pin
-        .flags.io_od_mode = true // enable open-drain mode for 1-wire bus
-    };
-    ESP_GOTO_ON_ERROR(rmt_new_tx_channel(&onewire_tx_channel_cfg, &handle->tx_channel),
-                      err, TAG, "create rmt tx channel failed");
-    ESP_LOGI(TAG, "RMT Rx channel created for 1-wire bus");
+    // check presence pulse and decode read slots in time order, updating CRC on the way
+    size_t low = 0;
+    for (size_t i = 0; i < symbol_num; i ++) {
+        for (size_t half = 0; half < 2; half ++) {
+            uint16_t duration = onewire_rmt_low_duration(&rmt_symbols[i], half);
+            if (duration == 0) {
+                continue;
+            }
 
-    // allocate rmt rx symbol buffer
-    handle->rx_symbols = malloc(config->max_rx_bytes * sizeof(rmt_symbol_word_t) * 8);
-    ESP_GOTO_ON_FALSE(handle->rx_symbols, ESP_ERR_NO_MEM, err, TAG, "memory allocation for rx symbol buffer failed");
-    handle->max_rx_bytes = config->max_rx_bytes;
+            if (low == presence_low) {
+                if (duration <= ONEWIRE_RESET_PRESENSE_DURATION_MIN || duration >= ONEWIRE_RESET_PRESENSE_DURATION_MAX) {
+                    return ESP_ERR_NOT_FOUND;
+                }
+            } else if (low >= rx_first_low) {
+                size_t bit = low - rx_first_low;
+                if (duration > ONEWIRE_SLOT_BIT_SAMPLE_TIME) { // 0 bit
+                    rx_data[bit / 8] &= ~(1 << (bit % 8)); // LSB first
+                    *crc8 = onewire_rmt_crc8_update_bit(*crc8, 0);
+                } else { // 1 bit
+                    rx_data[bit / 8] |= 1 << (bit % 8);
+                    *crc8 = onewire_rmt_crc8_update_bit(*crc8, 1);
+                }
+            }
+            low ++;
+        }
+    }
 
-    handle->receive_queue = xQueueCreate(1, sizeof(rmt_rx_done_event_data_t));
-    ESP_GOTO_ON_FALSE(handle->receive_queue, ESP_ERR_NO_MEM, err, TAG, "receive queue creation failed");
+    return ESP_OK;
+}
 
-    // register rmt rx done callback
-    rmt_rx_event_callbacks_t cbs = {
-        .on_recv_done = onewire_rmt_rx_done_callback
-    };
-    ESP_GOTO_ON_ERROR(rmt_rx_register_event_callbacks(handle->rx_channel, &cbs, handle),
-                      err, TAG, "enable rmt rx channel failed");
+static bool onewire_rmt_rx_done_callback(rmt_channel_handle_t channel, const rmt_rx_done_event_data_t *edata, void *user_data)
+{
+    BaseType_t task_woken = pdFALSE;
+    onewire_bus_rmt_obj_t *handle = (onewire_bus_rmt_obj_t *)user_data;
+
+    portENTER_CRITICAL_ISR(&handle->rx_lock);
+    if (handle->rx_waiting_task) { // caller is still waiting, so its buffer is still valid
+        uint8_t crc8 = 0;
+        switch (handle->rx_mode) {
+        case ONEWIRE_RMT_RX_PRESENCE:
+            handle->rx_result = onewire_rmt_check_presence_pulse(edata->received_symbols, edata->num_symbols) ?
+                                ESP_OK : ESP_ERR_NOT_FOUND;
+            break;
+        case ONEWIRE_RMT_RX_DATA:
+            onewire_rmt_decode_data(edata->received_symbols, edata->num_symbols, handle->rx_data, &crc8);
+            handle->rx_result = ESP_OK;
+            break;
+        case ONEWIRE_RMT_RX_TRANSACTION:
+            handle->rx_result = onewire_rmt_decode_transaction(edata->received_symbols, edata->num_symbols, handle->rx_slot_num,
+                                                               handle->rx_data, handle->rx_data_size, &crc8);
+            break;
+        }
+        handle->rx_crc8 = crc8;
 
-    // enable rmt channels
-    ESP_GOTO_ON_ERROR(rmt_enable(handle->rx_channel), err, TAG, "enable rmt rx channel failed");
-    ESP_GOTO_ON_ERROR(rmt_enable(handle->tx_channel), err, TAG, "enable rmt tx channel failed");
+        vTaskNotifyGiveFromISR(handle->rx_waiting_task, &task_woken);
+        handle->rx_waiting_task = NULL;
+    }
+    portEXIT_CRITICAL_ISR(&handle->rx_lock);
 
-    *handle_out = handle;
-    return ESP_OK;
+    return task_woken;
+}
 
-err:
-    if (handle) {
-        onewire_del_bus(handle);
-    }
+// deadline of a bus operation made of given reset pulses and slots, including rx idle detection, in ms
+static uint32_t onewire_rmt_timeout_ms(size_t reset_num, size_t slot_num)
+{
+    uint32_t duration_us = reset_num * (ONEWIRE_RESET_PULSE_DURATION + ONEWIRE_RESET_RECOVERY_DURATION) +
+                           slot_num * (ONEWIRE_SLOT_START_DURATION + ONEWIRE_SLOT_BIT_DURATION + ONEWIRE_SLOT_RECOVERY_DURATION) +
+                           onewire_rmt_rx_config.signal_range_max_ns / 1000;
 
-    return ret;
+    return (duration_us + 999) / 1000 + ONEWIRE_RMT_TIMEOUT_MARGIN_MS;
 }
 
-esp_err_t onewire_del_bus(onewire_bus_handle_t handle)
+static void onewire_rmt_cancel_receive(onewire_bus_rmt_obj_t *handle)
 {
-    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    portENTER_CRITICAL(&handle->rx_lock);
+    bool is_done = handle->rx_waiting_task == NULL;
+    handle->rx_waiting_task = NULL; // a late rx done callback must not touch caller's buffer any more
+    portEXIT_CRITICAL(&handle->rx_lock);
 
-    if (handle->tx_bytes_encoder) {
-        rmt_del_encoder(handle->tx_bytes_encoder);
-    }
-    if (handle->tx_copy_encoder) {
-        rmt_del_encoder(handle->tx_copy_encoder);
+    if (is_done) {
+        ulTaskNotifyTake(pdTRUE, 0); // receive finished right before cancelling, consume its notification
     }
-    if (handle->rx_channel) {
-        rmt_disable(handle->rx_channel);
-        rmt_del_channel(handle->rx_channel);
+}
+
+// arm rmt receive, rx done callback decodes received symbols into rx_data and notifies the calling task
+static esp_err_t onewire_rmt_receive(onewire_bus_rmt_obj_t *handle, onewire_rmt_rx_mode_t rx_mode, size_t symbol_num,
+                                     uint8_t *rx_data, size_t rx_data_size)
+{
+    portENTER_CRITICAL(&handle->rx_lock);
+    handle->rx_mode = rx_mode;
+    handle->rx_slot_num = rx_mode == ONEWIRE_RMT_RX_TRANSACTION ? symbol_num - 2 : 0; // minus reset and presence pulse
+    handle->rx_data = rx_data;
+    handle->rx_data_size = rx_data_size;
+    handle->rx_waiting_task = xTaskGetCurrentTaskHandle();
+    portEXIT_CRITICAL(&handle->rx_lock);
+
+    esp_err_t ret = rmt_receive(handle->rx_channel, handle->rx_symbols, symbol_num * sizeof(rmt_symbol_word_t), &onewire_rmt_rx_config);
+    if (ret != ESP_OK) {
+        onewire_rmt_cancel_receive(handle);
     }
-    if (handle->tx_channel) {
-        rmt_disable(handle->tx_channel);
-        rmt_del_channel(handle->tx_channel);
+
+    return ret;
+}
+
+// transmit symbols of an armed receive, cancel the receive if transmit fails
+static esp_err_t onewire_rmt_transmit_for_receive(onewire_bus_rmt_obj_t *handle, rmt_encoder_handle_t encoder,
+                                                  const void *payload, size_t payload_bytes)
+{
+    esp_err_t ret = rmt_transmit(handle->tx_channel, encoder, payload, payload_bytes, &onewire_rmt_tx_config);
+    if (ret != ESP_OK) {
+        onewire_rmt_cancel_receive(handle);
     }
-    if (handle->receive_queue) {
-        vQueueDelete(handle->receive_queue);
+
+    return ret;
+}
+
+static esp_err_t onewire_rmt_wait_receive_done(onewire_bus_rmt_obj_t *handle, size_t reset_num, size_t slot_num, uint8_t *crc8)
+{
+    // wait at least one full tick, so that a deadline shorter than tick period does not expire immediately
+    TickType_t timeout_ticks = pdMS_TO_TICKS(onewire_rmt_timeout_ms(reset_num, slot_num)) + 2;
+
+    if (ulTaskNotifyTake(pdTRUE, timeout_ticks) == 0) {
+        portENTER_CRITICAL(&handle->rx_lock);
+        bool is_timeout = handle->rx_waiting_task != NULL;
+        handle->rx_waiting_task = NULL;
+        portEXIT_CRITICAL(&handle->rx_lock);
+
+        if (is_timeout) {
+            return ESP_ERR_TIMEOUT;
+        }
+        ulTaskNotifyTake(pdTRUE, 0); // receive finished right at the deadline, consume its notification
     }
-    if (handle->rx_symbols) {
-        free(handle->rx_symbols);
+
+    if (crc8) {
+        *crc8 = handle->rx_crc8;
     }
-    free(handle);
 
-    return ESP_OK;
+    return handle->rx_result;
 }
 
-esp_err_t onewire_bus_reset(onewire_bus_handle_t handle)
+static esp_err_t onewire_rmt_reset(struct onewire_bus_t *bus)
 {
-    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
 
     // send reset pulse while receive presence pulse
-    ESP_RETURN_ON_ERROR(rmt_receive(handle->rx_channel, handle->rx_symbols, sizeof(rmt_symbol_word_t) * 2, &onewire_rmt_rx_config),
+    ESP_RETURN_ON_ERROR(onewire_rmt_receive(handle, ONEWIRE_RMT_RX_PRESENCE, 2, NULL, 0),
                         TAG, "1-wire reset pulse receive failed");
-    ESP_RETURN_ON_ERROR(rmt_transmit(handle->tx_channel, handle->tx_copy_encoder, &onewire_reset_pulse_symbol, sizeof(onewire_reset_pulse_symbol), &onewire_rmt_tx_config),
+    ESP_RETURN_ON_ERROR(onewire_rmt_transmit_for_receive(handle, handle->tx_copy_encoder, &onewire_reset_pulse_symbol, sizeof(onewire_reset_pulse_symbol)),
                         TAG, "1-wire reset pulse transmit failed");
 
     // wait and check presence pulse
-    bool is_present = false;
-    rmt_rx_done_event_data_t rmt_rx_evt_data;
-    if (xQueueReceive(handle->receive_queue, &rmt_rx_evt_data, pdMS_TO_TICKS(1000)) == pdPASS) {
-        is_present = onewire_rmt_check_presence_pulse(rmt_rx_evt_data.received_symbols, rmt_rx_evt_data.num_symbols);
+    if (onewire_rmt_wait_receive_done(handle, 1, 0, NULL) != ESP_OK) {
+        ESP_LOGE(TAG, "no device present on 1-wire bus");
+        return ESP_ERR_NOT_FOUND;
     }
 
-    return is_present ? ESP_OK : ESP_ERR_NOT_FOUND;
+    return ESP_OK;
 }
 
-esp_err_t onewire_bus_write_bytes(onewire_bus_handle_t handle, const uint8_t *tx_data, uint8_t tx_data_size)
+static esp_err_t onewire_rmt_write_bytes(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size)
 {
-    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
-    ESP_RETURN_ON_FALSE(tx_data && tx_data_size != 0, ESP_ERR_INVALID_ARG, TAG, "invalid tx buffer or buffer size");
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
 
     // transmit data
     ESP_RETURN_ON_ERROR(rmt_transmit(handle->tx_channel, handle->tx_bytes_encoder, tx_data, tx_data_size, &onewire_rmt_tx_config),
                         TAG, "1-wire data transmit failed");
 
     // wait the transmission to complete
-    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(handle->tx_channel, 50), TAG, "wait for 1-wire data transmit failed");
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(handle->tx_channel, onewire_rmt_timeout_ms(0, tx_data_size * 8)),
+                        TAG, "wait for 1-wire data transmit failed");
 
     return ESP_OK;
 }
 
-esp_err_t onewire_bus_read_bytes(onewire_bus_handle_t handle, uint8_t *rx_data, size_t rx_data_size)
+static esp_err_t onewire_rmt_read_bytes(struct onewire_bus_t *bus, uint8_t *rx_data, size_t rx_data_size)
 {
-    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
-    ESP_RETURN_ON_FALSE(rx_data && rx_data_size != 0, ESP_ERR_INVALID_ARG, TAG, "invalid rx buffer or buffer size");
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
     ESP_RETURN_ON_FALSE(!(rx_data_size > handle->max_rx_bytes), ESP_ERR_INVALID_ARG,
                         TAG, "rx_data_size too large for buffer to hold");
 
     uint8_t tx_buffer[rx_data_size];
     memset(tx_buffer, 0xFF, rx_data_size); // transmit one bits to generate read clock
 
-    // transmit 1 bits while receiving
-    ESP_RETURN_ON_ERROR(rmt_receive(handle->rx_channel, handle->rx_symbols, rx_data_size * 8 * sizeof(rmt_symbol_word_t), &onewire_rmt_rx_config),
-                        TAG, "1-wire data receive failed");
-    ESP_RETURN_ON_ERROR(rmt_transmit(handle->tx_channel, handle->tx_bytes_encoder, tx_buffer, sizeof(tx_buffer), &onewire_rmt_tx_config),
-                        TAG, "1-wire data transmit failed");
+    // receive in chunks that fit rx memory, slots of the next chunk follow right after
+    for (size_t offset = 0; offset < rx_data_size;) {
+        size_t chunk_size = rx_data_size - offset;
+        if (chunk_size > handle->rx_slot_max / 8) {
+            chunk_size = handle->rx_slot_max / 8;
+        }
+
+        // transmit 1 bits while receiving, received data is decoded right into rx_data
+        ESP_RETURN_ON_ERROR(onewire_rmt_receive(handle, ONEWIRE_RMT_RX_DATA, chunk_size * 8, rx_data + offset, chunk_size),
+                            TAG, "1-wire data receive failed");
+        ESP_RETURN_ON_ERROR(onewire_rmt_transmit_for_receive(handle, handle->tx_bytes_encoder, tx_buffer, chunk_size),
+                            TAG, "1-wire data transmit failed");
 
-    // wait the transmission finishes and decode data
-    rmt_rx_done_event_data_t rmt_rx_evt_data;
-    if (xQueueReceive(handle->receive_queue, &rmt_rx_evt_data, pdMS_TO_TICKS(1000)) == pdPASS) {
-        onewire_rmt_decode_data(rmt_rx_evt_data.received_symbols, rmt_rx_evt_data.num_symbols, rx_data);
-    } else {
-        return ESP_ERR_TIMEOUT;
+        // wait the transmission finishes
+        ESP_RETURN_ON_ERROR(onewire_rmt_wait_receive_done(handle, 0, chunk_size * 8, NULL),
+                            TAG, "wait for 1-wire data receive failed");
+        offset += chunk_size;
     }
 
     return ESP_OK;
 }
 
-esp_err_t onewire_bus_write_bit(onewire_bus_handle_t handle, uint8_t tx_bit)
+static esp_err_t onewire_rmt_write_bit(struct onewire_bus_t *bus, uint8_t tx_bit)
 {
-    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
 
     const rmt_symbol_word_t *symbol_to_transmit = tx_bit ? &onewire_bit1_symbol : &onewire_bit0_symbol;
 
@@ -408,31 +535,260 @@ esp_err_t onewire_bus_write_bit(onewire_bus_handle_t handle, uint8_t tx_bit)
                         TAG, "1-wire bit transmit failed");
 
     // wait the transmission to complete
-    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(handle->tx_channel, 50), TAG, "wait for 1-wire bit transmit failed");
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(handle->tx_channel, onewire_rmt_timeout_ms(0, 1)),
+                        TAG, "wait for 1-wire bit transmit failed");
 
     return ESP_OK;
 }
 
-esp_err_t onewire_bus_read_bit(onewire_bus_handle_t handle, uint8_t *rx_bit)
+static esp_err_t onewire_rmt_read_bit(struct onewire_bus_t *bus, uint8_t *rx_bit)
 {
-    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
-    ESP_RETURN_ON_FALSE(rx_bit, ESP_ERR_INVALID_ARG, TAG, "invalid rx_bit pointer");
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
+
+    uint8_t rx_buffer[1];
 
     // transmit 1 bit while receiving
-    ESP_RETURN_ON_ERROR(rmt_receive(handle->rx_channel, handle->rx_symbols, sizeof(rmt_symbol_word_t), &onewire_rmt_rx_config),
+    ESP_RETURN_ON_ERROR(onewire_rmt_receive(handle, ONEWIRE_RMT_RX_DATA, 1, rx_buffer, sizeof(rx_buffer)),
                         TAG, "1-wire bit receive failed");
-    ESP_RETURN_ON_ERROR(rmt_transmit(handle->tx_channel, handle->tx_copy_encoder, &onewire_bit1_symbol, sizeof(onewire_bit1_symbol), &onewire_rmt_tx_config),
+    ESP_RETURN_ON_ERROR(onewire_rmt_transmit_for_receive(handle, handle->tx_copy_encoder, &onewire_bit1_symbol, sizeof(onewire_bit1_symbol)),
                         TAG, "1-wire bit transmit failed");
 
-    // wait the transmission finishes and decode data
-    rmt_rx_done_event_data_t rmt_rx_evt_data;
-    if (xQueueReceive(handle->receive_queue, &rmt_rx_evt_data, pdMS_TO_TICKS(1000)) == pdPASS) {
-        uint8_t rx_buffer[1];
-        onewire_rmt_decode_data(rmt_rx_evt_data.received_symbols, rmt_rx_evt_data.num_symbols, rx_buffer);
-        *rx_bit = rx_buffer[0] & 0x01;
-    } else {
-        return ESP_ERR_TIMEOUT;
+    // wait the transmission finishes
+    ESP_RETURN_ON_ERROR(onewire_rmt_wait_receive_done(handle, 0, 1, NULL), TAG, "wait for 1-wire bit receive failed");
+    *rx_bit = rx_buffer[0] & 0x01;
+
+    return ESP_OK;
+}
+
+// run transaction that does not fit rx memory as reset, write and chunked read
+static esp_err_t onewire_rmt_transact_split(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size,
+                                            uint8_t *rx_data, size_t rx_data_size, bool *rx_crc_valid)
+{
+    if (rx_crc_valid) {
+        *rx_crc_valid = false;
+    }
+
+    ESP_RETURN_ON_ERROR(onewire_rmt_reset(bus), TAG, "error while resetting bus");
+    if (tx_data_size) {
+        ESP_RETURN_ON_ERROR(onewire_rmt_write_bytes(bus, tx_data, tx_data_size), TAG, "error while writing bytes");
+    }
+    if (rx_data_size) {
+        ESP_RETURN_ON_ERROR(onewire_rmt_read_bytes(bus, rx_data, rx_data_size), TAG, "error while reading bytes");
+    }
+    if (rx_crc_valid) {
+        *rx_crc_valid = onewire_check_crc8(rx_data, rx_data_size) == 0; // CRC of data followed by its CRC byte is 0
     }
 
     return ESP_OK;
 }
+
+static esp_err_t onewire_rmt_transact(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size,
+                                      uint8_t *rx_data, size_t rx_data_size, bool *rx_crc_valid)
+{
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
+    ESP_RETURN_ON_FALSE(!(tx_data_size + rx_data_size > handle->max_rx_bytes), ESP_ERR_INVALID_ARG,
+                        TAG, "transaction too large for buffer to hold");
+
+    size_t slot_num = (tx_data_size + rx_data_size) * 8;
+    if (slot_num > handle->rx_slot_max) {
+        return onewire_rmt_transact_split(bus, tx_data, tx_data_size, rx_data, rx_data_size, rx_crc_valid);
+    }
+
+    // encode reset pulse, tx bits and read slots as one symbol stream
+    rmt_symbol_word_t *symbol = handle->tx_symbols;
+    *symbol ++ = onewire_transaction_reset_symbol;
+    for (size_t i = 0; i < tx_data_size; i ++) {
+        for (size_t bit = 0; bit < 8; bit ++) { // LSB first
+            *symbol ++ = (tx_data[i] & (1 << bit)) ? onewire_bit1_symbol : onewire_bit0_symbol;
+        }
+    }
+    for (size_t i = 0; i < rx_data_size * 8; i ++) {
+        *symbol ++ = onewire_bit1_symbol; // transmit one bits to generate read clock
+    }
+
+    // transmit the whole transaction while receiving, received data is decoded right into rx_data
+    ESP_RETURN_ON_ERROR(onewire_rmt_receive(handle, ONEWIRE_RMT_RX_TRANSACTION, slot_num + 2, rx_data, rx_data_size),
+                        TAG, "1-wire transaction receive failed");
+    ESP_RETURN_ON_ERROR(onewire_rmt_transmit_for_receive(handle, handle->tx_copy_encoder, handle->tx_symbols, (slot_num + 1) * sizeof(rmt_symbol_word_t)),
+                        TAG, "1-wire transaction transmit failed");
+
+    // wait the transaction finishes, presence pulse and CRC are checked while decoding
+    uint8_t crc8 = 0;
+    esp_err_t ret = onewire_rmt_wait_receive_done(handle, 1, slot_num, &crc8);
+    if (ret == ESP_ERR_NOT_FOUND) {
+        ESP_LOGE(TAG, "no device present on 1-wire bus");
+    }
+    if (rx_crc_valid) {
+        *rx_crc_valid = ret == ESP_OK && crc8 == 0; // CRC of data followed by its CRC byte is 0
+    }
+
+    return ret;
+}
+
+static esp_err_t onewire_rmt_search_triplet(struct onewire_bus_t *bus, uint8_t direction,
+                                            uint8_t *id_bit, uint8_t *cmp_id_bit, uint8_t *taken_direction)
+{
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
+
+    uint8_t rx_buffer[1];
+
+    // transmit 2 read slots while receiving, so the bit and its complement are read in one round trip
+    ESP_RETURN_ON_ERROR(onewire_rmt_receive(handle, ONEWIRE_RMT_RX_DATA, 2, rx_buffer, sizeof(rx_buffer)),
+                        TAG, "1-wire triplet receive failed");
+    ESP_RETURN_ON_ERROR(onewire_rmt_transmit_for_receive(handle, handle->tx_copy_encoder, onewire_read_two_bits_symbols, sizeof(onewire_read_two_bits_symbols)),
+                        TAG, "1-wire triplet transmit failed");
+    ESP_RETURN_ON_ERROR(onewire_rmt_wait_receive_done(handle, 0, 2, NULL), TAG, "wait for 1-wire triplet receive failed");
+
+    *id_bit = rx_buffer[0] & 0x01;
+    *cmp_id_bit = (rx_buffer[0] >> 1) & 0x01;
+
+    if (*id_bit && *cmp_id_bit) { // no devices participating in search, nothing to write
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    // all participating devices agree on the bit, or there is a discrepancy and the caller decides
+    *taken_direction = (*id_bit != *cmp_id_bit) ? *id_bit : (direction ? 0x01 : 0x00);
+
+    // write the direction bit right away
+    const rmt_symbol_word_t *symbol_to_transmit = *taken_direction ? &onewire_bit1_symbol : &onewire_bit0_symbol;
+    ESP_RETURN_ON_ERROR(rmt_transmit(handle->tx_channel, handle->tx_copy_encoder, symbol_to_transmit, sizeof(onewire_bit1_symbol), &onewire_rmt_tx_config),
+                        TAG, "1-wire direction bit transmit failed");
+    ESP_RETURN_ON_ERROR(rmt_tx_wait_all_done(handle->tx_channel, onewire_rmt_timeout_ms(0, 1)),
+                        TAG, "wait for 1-wire direction bit transmit failed");
+
+    return ESP_OK;
+}
+
+static esp_err_t onewire_rmt_del(struct onewire_bus_t *bus)
+{
+    onewire_bus_rmt_obj_t *handle = __containerof(bus, onewire_bus_rmt_obj_t, base);
+
+    if (handle->tx_bytes_encoder) {
+        rmt_del_encoder(handle->tx_bytes_encoder);
+    }
+    if (handle->tx_copy_encoder) {
+        rmt_del_encoder(handle->tx_copy_encoder);
+    }
+    if (handle->rx_channel) {
+        rmt_disable(handle->rx_channel);
+        rmt_del_channel(handle->rx_channel);
+    }
+    if (handle->tx_channel) {
+        rmt_disable(handle->tx_channel);
+        rmt_del_channel(handle->tx_channel);
+    }
+    if (handle->rx_symbols) {
+        free(handle->rx_symbols);
+    }
+    if (handle->tx_symbols) {
+        free(handle->tx_symbols);
+    }
+    free(handle);
+
+    return ESP_OK;
+}
+
+esp_err_t onewire_new_bus_rmt(onewire_rmt_config_t *config, onewire_bus_handle_t *handle_out)
+{
+    ESP_RETURN_ON_FALSE(config, ESP_ERR_INVALID_ARG, TAG, "invalid config pointer");
+    ESP_RETURN_ON_FALSE(handle_out, ESP_ERR_INVALID_ARG, TAG, "invalid handle pointer");
+
+    esp_err_t ret = ESP_OK;
+
+    onewire_bus_rmt_obj_t *handle = calloc(1, sizeof(onewire_bus_rmt_obj_t));
+    ESP_GOTO_ON_FALSE(handle, ESP_ERR_NO_MEM, err, TAG, "memory allocation for 1-wire bus handler failed");
+
+    handle->base.reset = onewire_rmt_reset;
+    handle->base.write_bytes = onewire_rmt_write_bytes;
+    handle->base.read_bytes = onewire_rmt_read_bytes;
+    handle->base.write_bit = onewire_rmt_write_bit;
+    handle->base.read_bit = onewire_rmt_read_bit;
+    handle->base.transact = onewire_rmt_transact;
+    handle->base.search_triplet = onewire_rmt_search_triplet;
+    handle->base.del = onewire_rmt_del;
+
+    // create rmt bytes encoder to transmit 1-wire commands and data
+    rmt_bytes_encoder_config_t bytes_encoder_config = {
+        .bit0 = onewire_bit0_symbol,
+        .bit1 = onewire_bit1_symbol,
+        .flags.msb_first = 0
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_bytes_encoder(&bytes_encoder_config, &handle->tx_bytes_encoder),
+                      err, TAG, "create data tx encoder failed");
+
+    // create rmt copy encoder to transmit 1-wire reset pulse or bits
+    rmt_copy_encoder_config_t copy_encoder_config = {};
+    ESP_GOTO_ON_ERROR(rmt_new_copy_encoder(&copy_encoder_config, &handle->tx_copy_encoder),
+                      err, TAG, "create reset pulse tx encoder failed");
+
+    // create rmt rx channel, receives that do not fit its memory are split
+#if SOC_RMT_SUPPORT_RX_PINGPONG
+    size_t rx_mem_block_num = 1;
+#else
+    size_t rx_mem_block_num = config->rx_mem_block_num ? config->rx_mem_block_num : 1;
+#endif
+    rmt_rx_channel_config_t onewire_rx_channel_cfg = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .gpio_num = config->gpio_pin,
+        .mem_block_symbols = rx_mem_block_num * ONEWIRE_RMT_MEM_BLOCK_SYMBOLS,
+        .resolution_hz = ONEWIRE_RMT_RESOLUTION_HZ, // in us
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_rx_channel(&onewire_rx_channel_cfg, &handle->rx_channel),
+                      err, TAG, "create rmt rx channel failed");
+    ESP_LOGI(TAG, "RMT Tx channel created for 1-wire bus");
+
+    // create rmt tx channel after rx channel
+    rmt_tx_channel_config_t onewire_tx_channel_cfg = {
+        .clk_src = RMT_CLK_SRC_DEFAULT,
+        .gpio_num = config->gpio_pin,
+        .mem_block_symbols = 64, // ping-pong is always avaliable on tx channel, save hardware memory blocks
+        .resolution_hz = ONEWIRE_RMT_RESOLUTION_HZ, // in us
+        .trans_queue_depth = 4,
+        .flags.io_loop_back = true, // make tx channel coexist with rx channel on the same gpio pin
+        .flags.io_od_mode = true // enable open-drain mode for 1-wire bus
+    };
+    ESP_GOTO_ON_ERROR(rmt_new_tx_channel(&onewire_tx_channel_cfg, &handle->tx_channel),
+                      err, TAG, "create rmt tx channel failed");
+    ESP_LOGI(TAG, "RMT Rx channel created for 1-wire bus");
+
+    // allocate rmt rx symbol buffer, with extra symbols for reset and presence pulse of a transaction
+    handle->rx_symbols = malloc((config->max_rx_bytes * 8 + 2) * sizeof(rmt_symbol_word_t));
+    ESP_GOTO_ON_FALSE(handle->rx_symbols, ESP_ERR_NO_MEM, err, TAG, "memory allocation for rx symbol buffer failed");
+
+    // allocate rmt tx symbol buffer, with extra symbol for reset pulse of a transaction
+    handle->tx_symbols = malloc((config->max_rx_bytes * 8 + 1) * sizeof(rmt_symbol_word_t));
+    ESP_GOTO_ON_FALSE(handle->tx_symbols, ESP_ERR_NO_MEM, err, TAG, "memory allocation for tx symbol buffer failed");
+    handle->max_rx_bytes = config->max_rx_bytes;
+#if SOC_RMT_SUPPORT_RX_PINGPONG
+    handle->rx_slot_max = config->max_rx_bytes * 8; // ping-pong receive is only limited by rx symbol buffer
+#else
+    handle->rx_slot_max = (rx_mem_block_num * ONEWIRE_RMT_MEM_BLOCK_SYMBOLS - 2) / 8 * 8; // room for reset and presence pulse
+#endif
+
+    portMUX_INITIALIZE(&handle->rx_lock);
+
+    // register rmt rx done callback
+    rmt_rx_event_callbacks_t cbs = {
+        .on_recv_done = onewire_rmt_rx_done_callback
+    };
+    ESP_GOTO_ON_ERROR(rmt_rx_register_event_callbacks(handle->rx_channel, &cbs, handle),
+                      err, TAG, "enable rmt rx channel failed");
+
+    // enable rmt channels
+    ESP_GOTO_ON_ERROR(rmt_enable(handle->rx_channel), err, TAG, "enable rmt rx channel failed");
+    ESP_GOTO_ON_ERROR(rmt_enable(handle->tx_channel), err, TAG, "enable rmt tx channel failed");
+
+    // create worker task after the bus is ready to serve requests
+    ESP_GOTO_ON_ERROR(onewire_bus_init_requests(&handle->base, config->request_queue_depth),
+                      err, TAG, "create request queue failed");
+
+    *handle_out = &handle->base;
+    return ESP_OK;
+
+err:
+    if (handle) {
+        onewire_del_bus(&handle->base);
+    }
+
+    return ret;
+}
@@ -0,0 +1,647 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <string.h>
+#include "sdkconfig.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_check.h"
+#include "onewire_bus.h"
+#include "onewire_bus_interface.h"
+#if CONFIG_IDF_TARGET_LINUX
+#include <time.h>
+#else
+#include "esp_timer.h"
+#endif
+
+static const char *TAG = "onewire_sim";
+
+/**
+ * @brief Duration of 1-wire bus operations on a real bus, in us
+ *
+ */
+#define ONEWIRE_SIM_RESET_DURATION 960 // reset pulse and presence detection
+#define ONEWIRE_SIM_SLOT_DURATION 64 // one read or write slot
+
+/**
+ * @brief DS18B20 commands and defaults understood by simulated devices
+ *
+ */
+#define ONEWIRE_SIM_FAMILY_DS18B20 0x28
+#define ONEWIRE_SIM_CMD_CONVERT_T 0x44
+#define ONEWIRE_SIM_CMD_WRITE_SCRATCHPAD 0x4E
+#define ONEWIRE_SIM_CMD_READ_SCRATCHPAD 0xBE
+#define ONEWIRE_SIM_CMD_COPY_SCRATCHPAD 0x48
+#define ONEWIRE_SIM_CMD_RECALL_E2 0xB8
+#define ONEWIRE_SIM_POWER_ON_TEMPERATURE 0x0550 // 85 Celsius
+#define ONEWIRE_SIM_DEFAULT_TEMPERATURE 0x0190 // 25 Celsius
+#define ONEWIRE_SIM_DEFAULT_TH 0x4B
+#define ONEWIRE_SIM_DEFAULT_TL 0x46
+#define ONEWIRE_SIM_DEFAULT_CONFIG 0x7F // 12 bit resolution
+#define ONEWIRE_SIM_CONVERSION_TIME_9B_US 93750 // doubled for each extra bit of resolution
+
+/**
+ * @brief What a simulated device does with the next slot
+ *
+ */
+typedef enum {
+    ONEWIRE_SIM_IDLE, /*!< not selected or command finished, release the bus */
+    ONEWIRE_SIM_ROM_COMMAND, /*!< receive ROM command after reset */
+    ONEWIRE_SIM_SEARCH, /*!< send ROM bit, send its complement, receive direction */
+    ONEWIRE_SIM_MATCH, /*!< receive ROM number and compare */
+    ONEWIRE_SIM_READ_ROM, /*!< send ROM number */
+    ONEWIRE_SIM_FUNCTION_COMMAND, /*!< receive function command after being selected */
+    ONEWIRE_SIM_CONVERTING, /*!< answer read slots with 0 until conversion finishes */
+    ONEWIRE_SIM_READ_SCRATCHPAD, /*!< send scratchpad */
+    ONEWIRE_SIM_WRITE_SCRATCHPAD, /*!< receive TH, TL and configuration */
+} onewire_sim_phase_t;
+
+typedef struct {
+    uint8_t rom_number[8];
+    int16_t temperature; /*!< temperature latched by the next conversion, in 1/16 Celsius */
+    bool present;
+
+    uint8_t scratchpad[9];
+    uint8_t eeprom[3]; /*!< TH, TL and configuration */
+    bool converting;
+    int64_t conversion_done_us; /*!< when running conversion finishes, in real time */
+
+    onewire_sim_phase_t phase;
+    size_t bit_pos; /*!< position in the command, ROM number or scratchpad being transferred */
+    uint8_t search_step; /*!< 0: ROM bit, 1: complement, 2: direction */
+    uint8_t command;
+
+    uint32_t crc_error_count; /*!< number of next scratchpad reads to corrupt */
+    uint32_t no_presence_count; /*!< number of next resets to miss */
+    bool is_corrupting; /*!< running scratchpad read is corrupted */
+} onewire_sim_device_t;
+
+typedef struct {
+    struct onewire_bus_t base; /*!< backend interface, must be the first member */
+
+    SemaphoreHandle_t lock; /*!< protects devices against onewire_sim_set_* from other tasks */
+    onewire_sim_device_t *devices;
+    size_t device_num;
+    uint32_t operation_gap_us; /*!< added to bus time per backend operation */
+    uint64_t bus_time_us;
+    int64_t (*now_us)(void); /*!< clock conversions run on */
+    int64_t operation_now_us; /*!< clock at the start of the running operation */
+} onewire_bus_sim_obj_t;
+
+static int64_t onewire_sim_system_now_us(void)
+{
+#if CONFIG_IDF_TARGET_LINUX
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+#else
+    return esp_timer_get_time();
+#endif
+}
+
+static inline uint8_t onewire_sim_get_bit(const uint8_t *data, size_t bit)
+{
+    return (data[bit / 8] >> (bit % 8)) & 0x01; // LSB first
+}
+
+static void onewire_sim_update_scratchpad_crc(onewire_sim_device_t *device)
+{
+    device->scratchpad[8] = onewire_check_crc8(device->scratchpad, 8);
+}
+
+static void onewire_sim_set_temperature_register(onewire_sim_device_t *device, int16_t raw)
+{
+    device->scratchpad[0] = (uint16_t)raw & 0xFF;
+    device->scratchpad[1] = (uint16_t)raw >> 8;
+    onewire_sim_update_scratchpad_crc(device);
+}
+
+static void onewire_sim_power_on(onewire_sim_device_t *device)
+{
+    memcpy(&device->scratchpad[2], device->eeprom, sizeof(device->eeprom));
+    device->scratchpad[5] = 0xFF; // reserved bytes
+    device->scratchpad[6] = 0x0C;
+    device->scratchpad[7] = 0x10;
+    onewire_sim_set_temperature_register(device, ONEWIRE_SIM_POWER_ON_TEMPERATURE);
+
+    device->converting = false;
+    device->phase = ONEWIRE_SIM_IDLE;
+}
+
+// latch temperature into scratchpad once conversion time has elapsed
+static void onewire_sim_update_conversion(onewire_sim_device_t *device, int64_t now_us)
+{
+    if (device->converting && now_us >= device->conversion_done_us) {
+        uint8_t unused_bits = 3 - ((device->scratchpad[4] >> 5) & 0x03); // undefined LSBs for lower resolutions
+        device->scratchpad[6] = 0x10 - (device->temperature & 0x0F); // no longer the power-on 0x0C
+        onewire_sim_set_temperature_register(device, device->temperature & ~((1 << unused_bits) - 1));
+        device->converting = false;
+    }
+}
+
+static bool onewire_sim_is_alarm(const onewire_sim_device_t *device)
+{
+    int8_t temperature = (int16_t)(device->scratchpad[0] | device->scratchpad[1] << 8) >> 4; // integer part
+    return temperature >= (int8_t)device->scratchpad[2] || temperature <= (int8_t)device->scratchpad[3];
+}
+
+static void onewire_sim_start_phase(onewire_sim_device_t *device, onewire_sim_phase_t phase)
+{
+    device->phase = phase;
+    device->bit_pos = 0;
+    device->search_step = 0;
+    device->command = 0;
+}
+
+static void onewire_sim_run_rom_command(onewire_sim_device_t *device)
+{
+    switch (device->command) {
+    case ONEWIRE_CMD_SEARCH_ROM:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_SEARCH);
+        break;
+    case ONEWIRE_CMD_ALARM_SEARCH_ROM:
+        onewire_sim_start_phase(device, onewire_sim_is_alarm(device) ? ONEWIRE_SIM_SEARCH : ONEWIRE_SIM_IDLE);
+        break;
+    case ONEWIRE_CMD_MATCH_ROM:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_MATCH);
+        break;
+    case ONEWIRE_CMD_SKIP_ROM:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_FUNCTION_COMMAND);
+        break;
+    case ONEWIRE_CMD_READ_ROM:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_READ_ROM);
+        break;
+    default:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+        break;
+    }
+}
+
+static void onewire_sim_run_function_command(onewire_sim_device_t *device, int64_t now_us)
+{
+    switch (device->command) {
+    case ONEWIRE_SIM_CMD_CONVERT_T:
+        device->converting = true;
+        device->conversion_done_us = now_us +
+                                     (ONEWIRE_SIM_CONVERSION_TIME_9B_US << ((device->scratchpad[4] >> 5) & 0x03));
+        onewire_sim_start_phase(device, ONEWIRE_SIM_CONVERTING);
+        break;
+    case ONEWIRE_SIM_CMD_READ_SCRATCHPAD:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_READ_SCRATCHPAD);
+        device->is_corrupting = device->crc_error_count > 0;
+        if (device->is_corrupting) {
+            device->crc_error_count --;
+        }
+        break;
+    case ONEWIRE_SIM_CMD_WRITE_SCRATCHPAD:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_WRITE_SCRATCHPAD);
+        break;
+    case ONEWIRE_SIM_CMD_COPY_SCRATCHPAD:
+        memcpy(device->eeprom, &device->scratchpad[2], sizeof(device->eeprom));
+        onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+        break;
+    case ONEWIRE_SIM_CMD_RECALL_E2:
+        memcpy(&device->scratchpad[2], device->eeprom, sizeof(device->eeprom));
+        onewire_sim_update_scratchpad_crc(device);
+        onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+        break;
+    default:
+        onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+        break;
+    }
+}
+
+// run one slot on a device, master_bit is 1 for read slots, returns 0 if device pulls the bus low
+static uint8_t onewire_sim_device_slot(onewire_sim_device_t *device, uint8_t master_bit, int64_t now_us)
+{
+    uint8_t device_bit = 1;
+
+    onewire_sim_update_conversion(device, now_us);
+
+    switch (device->phase) {
+    case ONEWIRE_SIM_IDLE:
+        break;
+    case ONEWIRE_SIM_ROM_COMMAND:
+    case ONEWIRE_SIM_FUNCTION_COMMAND:
+        device->command |= master_bit << device->bit_pos;
+        if (++ device->bit_pos == 8) {
+            if (device->phase == ONEWIRE_SIM_ROM_COMMAND) {
+                onewire_sim_run_rom_command(device);
+            } else {
+                onewire_sim_run_function_command(device, now_us);
+            }
+        }
+        break;
+    case ONEWIRE_SIM_SEARCH: {
+        uint8_t rom_bit = onewire_sim_get_bit(device->rom_number, device->bit_pos);
+        if (device->search_step == 0) {
+            device_bit = rom_bit;
+        } else if (device->search_step == 1) {
+            device_bit = !rom_bit;
+        } else if (master_bit != rom_bit) { // master took the other direction
+            onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+            break;
+        } else if (++ device->bit_pos == 64) {
+            onewire_sim_start_phase(device, ONEWIRE_SIM_FUNCTION_COMMAND);
+            break;
+        }
+        device->search_step = (device->search_step + 1) % 3;
+        break;
+    }
+    case ONEWIRE_SIM_MATCH:
+        if (master_bit != onewire_sim_get_bit(device->rom_number, device->bit_pos)) {
+            onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+        } else if (++ device->bit_pos == 64) {
+            onewire_sim_start_phase(device, ONEWIRE_SIM_FUNCTION_COMMAND);
+        }
+        break;
+    case ONEWIRE_SIM_READ_ROM:
+        device_bit = onewire_sim_get_bit(device->rom_number, device->bit_pos);
+        if (++ device->bit_pos == 64) {
+            onewire_sim_start_phase(device, ONEWIRE_SIM_FUNCTION_COMMAND);
+        }
+        break;
+    case ONEWIRE_SIM_CONVERTING:
+        device_bit = device->converting ? 0 : 1;
+        break;
+    case ONEWIRE_SIM_READ_SCRATCHPAD:
+        if (device->bit_pos < sizeof(device->scratchpad) * 8) { // master may stop reading any time
+            device_bit = onewire_sim_get_bit(device->scratchpad, device->bit_pos);
+            if (device->is_corrupting && device->bit_pos == 0) { // flip temperature LSB on the wire only
+                device_bit ^= 1;
+            }
+            device->bit_pos ++;
+        }
+        break;
+    case ONEWIRE_SIM_WRITE_SCRATCHPAD: {
+        uint8_t *byte = &device->scratchpad[2 + device->bit_pos / 8];
+        *byte = (*byte & ~(1 << (device->bit_pos % 8))) | master_bit << (device->bit_pos % 8);
+        if (++ device->bit_pos == 24) {
+            device->scratchpad[4] = (device->scratchpad[4] & 0x60) | 0x1F; // only resolution bits are writable
+            onewire_sim_update_scratchpad_crc(device);
+            onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+        }
+        break;
+    }
+    }
+
+    return device_bit;
+}
+
+// run one slot on the bus, all present devices see it and the bus is low if any of them pulls it down
+static uint8_t onewire_sim_bus_slot(onewire_bus_sim_obj_t *handle, uint8_t master_bit)
+{
+    uint8_t bus_bit = master_bit;
+
+    for (size_t i = 0; i < handle->device_num; i ++) {
+        if (handle->devices[i].present) {
+            bus_bit &= onewire_sim_device_slot(&handle->devices[i], master_bit, handle->operation_now_us);
+        }
+    }
+    handle->bus_time_us += ONEWIRE_SIM_SLOT_DURATION;
+
+    return bus_bit;
+}
+
+// reset pulse on the bus, return true if any device answered with a presence pulse
+static bool onewire_sim_bus_reset(onewire_bus_sim_obj_t *handle)
+{
+    bool is_present = false;
+
+    for (size_t i = 0; i < handle->device_num; i ++) {
+        onewire_sim_device_t *device = &handle->devices[i];
+        if (!device->present) {
+            continue;
+        }
+        onewire_sim_update_conversion(device, handle->operation_now_us); // conversion goes on in the background
+        if (device->no_presence_count > 0) { // device missed the reset, it ignores slots until the next one
+            device->no_presence_count --;
+            onewire_sim_start_phase(device, ONEWIRE_SIM_IDLE);
+            continue;
+        }
+        onewire_sim_start_phase(device, ONEWIRE_SIM_ROM_COMMAND);
+        is_present = true;
+    }
+    handle->bus_time_us += ONEWIRE_SIM_RESET_DURATION;
+
+    return is_present;
+}
+
+static void onewire_sim_bus_write(onewire_bus_sim_obj_t *handle, const uint8_t *tx_data, size_t tx_data_size)
+{
+    for (size_t bit = 0; bit < tx_data_size * 8; bit ++) {
+        onewire_sim_bus_slot(handle, onewire_sim_get_bit(tx_data, bit));
+    }
+}
+
+static void onewire_sim_bus_read(onewire_bus_sim_obj_t *handle, uint8_t *rx_data, size_t rx_data_size)
+{
+    memset(rx_data, 0, rx_data_size);
+    for (size_t bit = 0; bit < rx_data_size * 8; bit ++) {
+        rx_data[bit / 8] |= onewire_sim_bus_slot(handle, 1) << (bit % 8); // LSB first
+    }
+}
+
+// start a backend operation, which costs the configured gap on top of its slots, the clock is read once for all slots
+static void onewire_sim_begin_operation(onewire_bus_sim_obj_t *handle)
+{
+    xSemaphoreTake(handle->lock, portMAX_DELAY);
+    handle->bus_time_us += handle->operation_gap_us;
+    handle->operation_now_us = handle->now_us();
+}
+
+static esp_err_t onewire_sim_reset(struct onewire_bus_t *bus)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    onewire_sim_begin_operation(handle);
+    bool is_present = onewire_sim_bus_reset(handle);
+    xSemaphoreGive(handle->lock);
+
+    if (!is_present) {
+        ESP_LOGE(TAG, "no device present on 1-wire bus");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    return ESP_OK;
+}
+
+static esp_err_t onewire_sim_write_bytes(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    onewire_sim_begin_operation(handle);
+    onewire_sim_bus_write(handle, tx_data, tx_data_size);
+    xSemaphoreGive(handle->lock);
+
+    return ESP_OK;
+}
+
+static esp_err_t onewire_sim_read_bytes(struct onewire_bus_t *bus, uint8_t *rx_data, size_t rx_data_size)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    onewire_sim_begin_operation(handle);
+    onewire_sim_bus_read(handle, rx_data, rx_data_size);
+    xSemaphoreGive(handle->lock);
+
+    return ESP_OK;
+}
+
+static esp_err_t onewire_sim_write_bit(struct onewire_bus_t *bus, uint8_t tx_bit)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    onewire_sim_begin_operation(handle);
+    onewire_sim_bus_slot(handle, tx_bit ? 1 : 0);
+    xSemaphoreGive(handle->lock);
+
+    return ESP_OK;
+}
+
+static esp_err_t onewire_sim_read_bit(struct onewire_bus_t *bus, uint8_t *rx_bit)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    onewire_sim_begin_operation(handle);
+    *rx_bit = onewire_sim_bus_slot(handle, 1);
+    xSemaphoreGive(handle->lock);
+
+    return ESP_OK;
+}
+
+// reset, write and read as one operation, same slots as running them one by one
+static esp_err_t onewire_sim_transact(struct onewire_bus_t *bus, const uint8_t *tx_data, uint8_t tx_data_size,
+                                      uint8_t *rx_data, size_t rx_data_size, bool *rx_crc_valid)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    if (rx_crc_valid) {
+        *rx_crc_valid = false;
+    }
+
+    onewire_sim_begin_operation(handle);
+    bool is_present = onewire_sim_bus_reset(handle);
+    if (is_present && tx_data_size) {
+        onewire_sim_bus_write(handle, tx_data, tx_data_size);
+    }
+    if (is_present && rx_data_size) {
+        onewire_sim_bus_read(handle, rx_data, rx_data_size);
+    }
+    xSemaphoreGive(handle->lock);
+
+    if (!is_present) {
+        ESP_LOGE(TAG, "no device present on 1-wire bus");
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (rx_crc_valid) {
+        *rx_crc_valid = onewire_check_crc8(rx_data, rx_data_size) == 0; // CRC of data followed by its CRC byte is 0
+    }
+
+    return ESP_OK;
+}
+
+// two read slots and the direction slot as one operation
+static esp_err_t onewire_sim_search_triplet(struct onewire_bus_t *bus, uint8_t direction,
+                                            uint8_t *id_bit, uint8_t *cmp_id_bit, uint8_t *taken_direction)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+    esp_err_t ret = ESP_OK;
+
+    onewire_sim_begin_operation(handle);
+    *id_bit = onewire_sim_bus_slot(handle, 1);
+    *cmp_id_bit = onewire_sim_bus_slot(handle, 1);
+    if (*id_bit && *cmp_id_bit) { // no devices participating in search, nothing to write
+        ret = ESP_ERR_NOT_FOUND;
+    } else {
+        *taken_direction = (*id_bit != *cmp_id_bit) ? *id_bit : (direction ? 0x01 : 0x00);
+        onewire_sim_bus_slot(handle, *taken_direction);
+    }
+    xSemaphoreGive(handle->lock);
+
+    return ret;
+}
+
+static esp_err_t onewire_sim_del(struct onewire_bus_t *bus)
+{
+    onewire_bus_sim_obj_t *handle = __containerof(bus, onewire_bus_sim_obj_t, base);
+
+    if (handle->lock) {
+        vSemaphoreDelete(handle->lock);
+    }
+    if (handle->devices) {
+        free(handle->devices);
+    }
+    free(handle);
+
+    return ESP_OK;
+}
+
+// get simulated bus object, NULL if handle is not a simulated bus
+static onewire_bus_sim_obj_t *onewire_sim_get_obj(onewire_bus_handle_t handle)
+{
+    if (!handle || handle->del != onewire_sim_del) {
+        return NULL;
+    }
+
+    return __containerof(handle, onewire_bus_sim_obj_t, base);
+}
+
+esp_err_t onewire_new_bus_sim(onewire_sim_config_t *config, onewire_bus_handle_t *handle_out)
+{
+    ESP_RETURN_ON_FALSE(config, ESP_ERR_INVALID_ARG, TAG, "invalid config pointer");
+    ESP_RETURN_ON_FALSE(handle_out, ESP_ERR_INVALID_ARG, TAG, "invalid handle pointer");
+
+    static uint32_t serial_seed = 0; // so that generated ROM numbers differ between buses
+
+    esp_err_t ret = ESP_OK;
+
+    onewire_bus_sim_obj_t *handle = calloc(1, sizeof(onewire_bus_sim_obj_t));
+    ESP_GOTO_ON_FALSE(handle, ESP_ERR_NO_MEM, err, TAG, "memory allocation for 1-wire bus handler failed");
+
+    handle->base.reset = onewire_sim_reset;
+    handle->base.write_bytes = onewire_sim_write_bytes;
+    handle->base.read_bytes = onewire_sim_read_bytes;
+    handle->base.write_bit = onewire_sim_write_bit;
+    handle->base.read_bit = onewire_sim_read_bit;
+    if (!config->is_step_by_step) {
+        handle->base.transact = onewire_sim_transact;
+        handle->base.search_triplet = onewire_sim_search_triplet;
+    }
+    handle->base.del = onewire_sim_del;
+
+    handle->lock = xSemaphoreCreateMutex();
+    ESP_GOTO_ON_FALSE(handle->lock, ESP_ERR_NO_MEM, err, TAG, "create lock failed");
+
+    if (config->device_num) {
+        handle->devices = calloc(config->device_num, sizeof(onewire_sim_device_t));
+        ESP_GOTO_ON_FALSE(handle->devices, ESP_ERR_NO_MEM, err, TAG, "memory allocation for devices failed");
+    }
+    handle->device_num = config->device_num;
+    handle->operation_gap_us = config->operation_gap_us;
+    handle->now_us = config->now_us ? config->now_us : onewire_sim_system_now_us;
+
+    for (size_t i = 0; i < handle->device_num; i ++) {
+        onewire_sim_device_t *device = &handle->devices[i];
+        if (config->devices) {
+            memcpy(device->rom_number, config->devices[i].rom_number, sizeof(device->rom_number));
+            device->temperature = config->devices[i].temperature;
+        } else { // deterministic pseudo random serial number, xorshift
+            uint32_t serial = ++ serial_seed * 2654435761u;
+            for (size_t byte = 1; byte < 7; byte ++) {
+                serial ^= serial << 13;
+                serial ^= serial >> 17;
+                serial ^= serial << 5;
+                device->rom_number[byte] = serial & 0xFF;
+            }
+            device->rom_number[0] = ONEWIRE_SIM_FAMILY_DS18B20;
+            device->temperature = ONEWIRE_SIM_DEFAULT_TEMPERATURE;
+        }
+        device->rom_number[7] = onewire_check_crc8(device->rom_number, 7);
+        device->eeprom[0] = ONEWIRE_SIM_DEFAULT_TH;
+        device->eeprom[1] = ONEWIRE_SIM_DEFAULT_TL;
+        device->eeprom[2] = ONEWIRE_SIM_DEFAULT_CONFIG;
+        device->present = true;
+        onewire_sim_power_on(device);
+    }
+
+    ESP_GOTO_ON_ERROR(onewire_bus_init_requests(&handle->base, config->request_queue_depth),
+                      err, TAG, "create request queue failed");
+    ESP_LOGI(TAG, "simulated 1-wire bus created with %u devices", (unsigned int)handle->device_num);
+
+    *handle_out = &handle->base;
+    return ESP_OK;
+
+err:
+    if (handle) {
+        onewire_del_bus(&handle->base);
+    }
+
+    return ret;
+}
+
+esp_err_t onewire_sim_set_temperature(onewire_bus_handle_t handle, size_t device_index, int16_t temperature)
+{
+    onewire_bus_sim_obj_t *sim = onewire_sim_get_obj(handle);
+    ESP_RETURN_ON_FALSE(sim, ESP_ERR_INVALID_ARG, TAG, "invalid simulated 1-wire handle");
+    ESP_RETURN_ON_FALSE(device_index < sim->device_num, ESP_ERR_INVALID_ARG, TAG, "invalid device index");
+
+    xSemaphoreTake(sim->lock, portMAX_DELAY);
+    sim->devices[device_index].temperature = temperature;
+    xSemaphoreGive(sim->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t onewire_sim_set_present(onewire_bus_handle_t handle, size_t device_index, bool present)
+{
+    onewire_bus_sim_obj_t *sim = onewire_sim_get_obj(handle);
+    ESP_RETURN_ON_FALSE(sim, ESP_ERR_INVALID_ARG, TAG, "invalid simulated 1-wire handle");
+    ESP_RETURN_ON_FALSE(device_index < sim->device_num, ESP_ERR_INVALID_ARG, TAG, "invalid device index");
+
+    xSemaphoreTake(sim->lock, portMAX_DELAY);
+    onewire_sim_device_t *device = &sim->devices[device_index];
+    if (present && !device->present) {
+        onewire_sim_power_on(device);
+    }
+    device->present = present;
+    xSemaphoreGive(sim->lock);
+
+    return ESP_OK;
+}
+
+esp_err_t onewire_sim_inject_fault(onewire_bus_handle_t handle, size_t device_index, onewire_sim_fault_t fault, uint32_t count)
+{
+    onewire_bus_sim_obj_t *sim = onewire_sim_get_obj(handle);
+    ESP_RETURN_ON_FALSE(sim, ESP_ERR_INVALID_ARG, TAG, "invalid simulated 1-wire handle");
+    ESP_RETURN_ON_FALSE(device_index < sim->device_num, ESP_ERR_INVALID_ARG, TAG, "invalid device index");
+
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(sim->lock, portMAX_DELAY);
+    onewire_sim_device_t *device = &sim->devices[device_index];
+    switch (fault) {
+    case ONEWIRE_SIM_FAULT_CRC_ERROR:
+        device->crc_error_count = count;
+        break;
+    case ONEWIRE_SIM_FAULT_NO_PRESENCE:
+        device->no_presence_count = count;
+        break;
+    default:
+        ret = ESP_ERR_INVALID_ARG;
+        break;
+    }
+    xSemaphoreGive(sim->lock);
+
+    ESP_RETURN_ON_ERROR(ret, TAG, "invalid fault");
+
+    return ESP_OK;
+}
+
+esp_err_t onewire_sim_get_rom_number(onewire_bus_handle_t handle, size_t device_index, uint8_t *rom_number_out)
+{
+    onewire_bus_sim_obj_t *sim = onewire_sim_get_obj(handle);
+    ESP_RETURN_ON_FALSE(sim, ESP_ERR_INVALID_ARG, TAG, "invalid simulated 1-wire handle");
+    ESP_RETURN_ON_FALSE(device_index < sim->device_num, ESP_ERR_INVALID_ARG, TAG, "invalid device index");
+    ESP_RETURN_ON_FALSE(rom_number_out, ESP_ERR_INVALID_ARG, TAG, "invalid rom_number pointer");
+
+    memcpy(rom_number_out, sim->devices[device_index].rom_number, sizeof(sim->devices[device_index].rom_number));
+
+    return ESP_OK;
+}
+
+uint64_t onewire_sim_get_bus_time_us(onewire_bus_handle_t handle)
+{
+    onewire_bus_sim_obj_t *sim = onewire_sim_get_obj(handle);
+    if (!sim) {
+        return 0;
+    }
+
+    xSemaphoreTake(sim->lock, portMAX_DELAY);
+    uint64_t bus_time_us = sim->bus_time_us;
+    xSemaphoreGive(sim->lock);
+
+    return bus_time_us;
+}
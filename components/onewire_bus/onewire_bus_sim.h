@@ -0,0 +1,128 @@
+/*
+ * SPDX-FileCopyrightText: 2022 Espressif Systems (Shanghai) CO LTD
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "onewire_bus_api.h"
+
+/**
+ * @brief Virtual DS18B20 device on a simulated 1-wire bus
+ *
+ */
+typedef struct {
+    uint8_t rom_number[8]; /*!< ROM number of the device, CRC byte is recalculated */
+    int16_t temperature; /*!< temperature measured by the device, in 1/16 Celsius */
+} onewire_sim_device_config_t;
+
+/**
+ * @brief Fault injected into a device on simulated 1-wire bus
+ *
+ */
+typedef enum {
+    ONEWIRE_SIM_FAULT_CRC_ERROR, /*!< a bit of the scratchpad is flipped on the wire, so its CRC does not match */
+    ONEWIRE_SIM_FAULT_NO_PRESENCE, /*!< device misses the reset, it sends no presence pulse and ignores the slots after it */
+} onewire_sim_fault_t;
+
+/**
+ * @brief Simulated 1-wire bus configuration
+ *
+ */
+typedef struct {
+    const onewire_sim_device_config_t *devices; /*!< devices on the bus, NULL to generate DS18B20 ROM numbers at 25 Celsius */
+    size_t device_num; /*!< number of devices on the bus */
+    uint8_t request_queue_depth; /*!< number of pending asynchronous requests, 0 to not support onewire_bus_submit() */
+    uint32_t operation_gap_us; /*!< bus time added per backend operation (reset, bytes, bit, transaction or search triplet),
+                                    e.g. waiting for an RMT transaction and starting the next, 0 to count slots only */
+    bool is_step_by_step; /*!< no native transaction and search triplet, the generic layer runs them
+                               with resets, bytes and bits, e.g. to compare their bus time */
+    int64_t (*now_us)(void); /*!< clock conversions run on, in us, NULL for the system clock.
+                                  A test can advance its own clock instead of waiting for conversions */
+} onewire_sim_config_t;
+
+/**
+ * @brief Install simulated 1-wire bus, which models devices bit by bit without any hardware
+ *
+ * @note Every slot on the bus is seen by all devices, and what they drive is wired-AND, so ROM search,
+ *       CRC errors and absent devices behave like on a real bus. Devices support ROM commands,
+ *       CONVERT T (taking the conversion time of the configured resolution on the now_us clock),
+ *       READ/WRITE/COPY SCRATCHPAD and RECALL E2.
+ *       Bus operations return immediately, the time they would take on a real bus is accumulated instead,
+ *       see onewire_sim_get_bus_time_us(). Transactions and search triplets are native operations, each
+ *       costing one operation_gap_us like a single reset or bit. Line faults are injected with onewire_sim_inject_fault().
+ *
+ * @param[in] config simulated 1-wire bus configuration
+ * @param[out] handle_out Created 1-wire bus handle
+ * @return
+ *         - ESP_OK                Create simulated 1-wire bus successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NO_MEM        Memory allocation failed.
+ */
+esp_err_t onewire_new_bus_sim(onewire_sim_config_t *config, onewire_bus_handle_t *handle_out);
+
+/**
+ * @brief Set temperature measured by a device on simulated 1-wire bus, it shows up after the next conversion
+ *
+ * @param[in] handle simulated 1-wire bus handle
+ * @param[in] device_index index of the device, in order of configuration
+ * @param[in] temperature temperature in 1/16 Celsius
+ * @return
+ *         - ESP_OK                Temperature is set.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument, or handle is not a simulated bus.
+ */
+esp_err_t onewire_sim_set_temperature(onewire_bus_handle_t handle, size_t device_index, int16_t temperature);
+
+/**
+ * @brief Attach or detach a device on simulated 1-wire bus, detached devices do not answer any slot
+ *
+ * @note An attached device starts with power-on scratchpad, like a real device plugged in.
+ *
+ * @param[in] handle simulated 1-wire bus handle
+ * @param[in] device_index index of the device, in order of configuration
+ * @param[in] present whether the device is attached
+ * @return
+ *         - ESP_OK                Device is attached or detached.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument, or handle is not a simulated bus.
+ */
+esp_err_t onewire_sim_set_present(onewire_bus_handle_t handle, size_t device_index, bool present);
+
+/**
+ * @brief Inject a fault into the next operations of a device on simulated 1-wire bus
+ *
+ * @note ONEWIRE_SIM_FAULT_CRC_ERROR affects the next count scratchpad reads of the device,
+ *       ONEWIRE_SIM_FAULT_NO_PRESENCE the next count bus resets. Count 0 clears the fault.
+ *
+ * @param[in] handle simulated 1-wire bus handle
+ * @param[in] device_index index of the device, in order of configuration
+ * @param[in] fault fault to inject
+ * @param[in] count number of operations the fault affects
+ * @return
+ *         - ESP_OK                Fault is injected.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument, or handle is not a simulated bus.
+ */
+esp_err_t onewire_sim_inject_fault(onewire_bus_handle_t handle, size_t device_index, onewire_sim_fault_t fault, uint32_t count);
+
+/**
+ * @brief Get ROM number of a device on simulated 1-wire bus
+ *
+ * @param[in] handle simulated 1-wire bus handle
+ * @param[in] device_index index of the device, in order of configuration
+ * @param[out] rom_number_out ROM number of the device
+ * @return
+ *         - ESP_OK                Get ROM number successfully.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument, or handle is not a simulated bus.
+ */
+esp_err_t onewire_sim_get_rom_number(onewire_bus_handle_t handle, size_t device_index, uint8_t *rom_number_out);
+
+/**
+ * @brief Get time all operations on simulated 1-wire bus would have taken on a real bus, in us
+ *
+ * @param[in] handle simulated 1-wire bus handle
+ * @return Accumulated bus time, 0 if handle is not a simulated bus
+ */
+uint64_t onewire_sim_get_bus_time_us(onewire_bus_handle_t handle);
@@ -5,6 +5,7 @@
 #include "non_volatile_storage.h"
 #include "task_monitor.h"
 #include "temperature.h"
+#include "time_sync.h"
 #include "wifi.h"
 
 void app_main(void)
@@ -13,6 +14,7 @@ void app_main(void)
 
     ESP_ERROR_CHECK(led_init());
     ESP_ERROR_CHECK(wifi_init());
+    ESP_ERROR_CHECK(time_sync_init());
     ESP_ERROR_CHECK(ds18b20_init());
     ESP_ERROR_CHECK(mqtt_init());
 
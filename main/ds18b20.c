@@ -4,34 +4,155 @@
  * SPDX-License-Identifier: Unlicense OR CC0-1.0
  */
 #include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 #include "ds18b20.h"
 #include "esp_check.h"
 
 static const char *TAG = "ds18b20";
 
+// fill tx_buffer with ROM command (MATCH ROM or SKIP ROM) followed by device command, return number of bytes filled
+static uint8_t ds18b20_build_command(uint8_t *tx_buffer, const uint8_t *rom_number, uint8_t command)
+{
+    if (rom_number) { // specify rom id
+        tx_buffer[0] = ONEWIRE_CMD_MATCH_ROM;
+        memcpy(&tx_buffer[1], rom_number, 8);
+        tx_buffer[9] = command;
+        return 10;
+    }
+
+    // skip rom id
+    tx_buffer[0] = ONEWIRE_CMD_SKIP_ROM;
+    tx_buffer[1] = command;
+    return 2;
+}
+
+// combine temperature bytes, cast after combining so negative temperatures keep their sign
+static int16_t ds18b20_build_raw_temperature(uint8_t temp_lsb, uint8_t temp_msb, uint8_t configuration)
+{
+    static const uint8_t lsb_mask[4] = { 0x07, 0x03, 0x01, 0x00 };
+    uint8_t lsb_masked = temp_lsb & (~lsb_mask[(configuration >> 5) & 0x03]); // mask bits not used in low resolution
+    return (int16_t)(((uint16_t)temp_msb << 8) | lsb_masked);
+}
+
 esp_err_t ds18b20_trigger_temperature_conversion(onewire_bus_handle_t handle, const uint8_t *rom_number)
 {
     ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
 
-    ESP_RETURN_ON_ERROR(onewire_bus_reset(handle), TAG, "error while resetting bus"); // reset bus and check if the device is present
+    uint8_t tx_buffer[10];
+    uint8_t tx_buffer_size = ds18b20_build_command(tx_buffer, rom_number, DS18B20_CMD_CONVERT_TEMP);
+
+    // reset bus, check if the device is present and trigger conversion in one transaction
+    ESP_RETURN_ON_ERROR(onewire_bus_transact(handle, tx_buffer, tx_buffer_size, NULL, 0, NULL),
+                        TAG, "error while triggering temperature convert");
+
+    return ESP_OK;
+}
+
+uint32_t ds18b20_get_conversion_time_ms(ds18b20_resolution_t resolution)
+{
+    uint8_t missing_bits = 3 - ((resolution >> 5) & 0x03); // R1 R0 of configuration register, 3 is 12-bit
+    return (DS18B20_CONVERSION_TIME_12B_MS + (1 << missing_bits) - 1) >> missing_bits;
+}
+
+esp_err_t ds18b20_wait_for_conversion(onewire_bus_handle_t handle, ds18b20_resolution_t resolution)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+
+    // one more tick so the whole conversion time has passed before giving up
+    const TickType_t timeout = pdMS_TO_TICKS(ds18b20_get_conversion_time_ms(resolution)) + 1;
+    const TickType_t start = xTaskGetTickCount();
+    uint8_t rx_bit;
+
+    while (true) {
+        ESP_RETURN_ON_ERROR(onewire_bus_read_bit(handle, &rx_bit), TAG, "error while polling conversion");
+        if (rx_bit) {
+            return ESP_OK; // no device holds the bus low any more
+        }
+        if (xTaskGetTickCount() - start > timeout) {
+            return ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(1); // a read slot is short, polling each tick keeps the bus free for the rest of the time
+    }
+}
+
+esp_err_t ds18b20_read_scratchpad(onewire_bus_handle_t handle, const uint8_t *rom_number, ds18b20_scratchpad_t *scratchpad)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(scratchpad, ESP_ERR_INVALID_ARG, TAG, "invalid scratchpad pointer");
 
     uint8_t tx_buffer[10];
-    uint8_t tx_buffer_size;
+    uint8_t tx_buffer_size = ds18b20_build_command(tx_buffer, rom_number, DS18B20_CMD_READ_SCRATCHPAD);
 
-    if (rom_number) { // specify rom id
-        tx_buffer[0] = ONEWIRE_CMD_MATCH_ROM;
-        tx_buffer[9] = DS18B20_CMD_CONVERT_TEMP;
-        memcpy(&tx_buffer[1], rom_number, 8);
-        tx_buffer_size = 10;
-    } else { // skip rom id
-        tx_buffer[0] = ONEWIRE_CMD_SKIP_ROM;
-        tx_buffer[1] = DS18B20_CMD_CONVERT_TEMP;
-        tx_buffer_size = 2;
+    // reset bus, check if the device is present, send read scratchpad command and read it in one transaction
+    bool crc_valid;
+    ESP_RETURN_ON_ERROR(onewire_bus_transact(handle, tx_buffer, tx_buffer_size, (uint8_t *)scratchpad, sizeof(*scratchpad), &crc_valid),
+                        TAG, "error while reading scratchpad");
+
+    ESP_RETURN_ON_FALSE(crc_valid, ESP_ERR_INVALID_CRC, TAG, "crc error"); // CRC is checked while the scratchpad is decoded
+
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_read_temperature_fast(onewire_bus_handle_t handle, const uint8_t *rom_number,
+                                        ds18b20_resolution_t resolution, int16_t *raw_temperature)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(raw_temperature, ESP_ERR_INVALID_ARG, TAG, "invalid temperature pointer");
+
+    uint8_t tx_buffer[10];
+    uint8_t tx_buffer_size = ds18b20_build_command(tx_buffer, rom_number, DS18B20_CMD_READ_SCRATCHPAD);
+
+    // stop after temperature lsb and msb, the device drops the rest of the scratchpad on the next reset
+    uint8_t rx_buffer[2];
+    ESP_RETURN_ON_ERROR(onewire_bus_transact(handle, tx_buffer, tx_buffer_size, rx_buffer, sizeof(rx_buffer), NULL),
+                        TAG, "error while reading temperature");
+    // checked before masking, as masked all ones differ by resolution
+    ESP_RETURN_ON_FALSE(rx_buffer[0] != 0xFF || rx_buffer[1] != 0xFF, ESP_ERR_INVALID_RESPONSE, TAG,
+                        "all bits read as 1, device may not have answered");
+
+    *raw_temperature = ds18b20_build_raw_temperature(rx_buffer[0], rx_buffer[1], resolution);
+
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_submit_read(onewire_bus_handle_t handle, const uint8_t *rom_number, bool is_fast,
+                              ds18b20_read_request_t *read)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(read, ESP_ERR_INVALID_ARG, TAG, "invalid read pointer");
+
+    // same transaction as the blocking reads, a fast read stops after temperature lsb and msb
+    read->is_fast = is_fast;
+    read->request.tx_data = read->tx_buffer;
+    read->request.tx_data_size = ds18b20_build_command(read->tx_buffer, rom_number, DS18B20_CMD_READ_SCRATCHPAD);
+    read->request.rx_data = (uint8_t *)&read->scratchpad;
+    read->request.rx_data_size = is_fast ? 2 : sizeof(read->scratchpad);
+
+    return onewire_bus_submit(handle, &read->request);
+}
+
+esp_err_t ds18b20_get_read_temperature(const ds18b20_read_request_t *read, esp_err_t result,
+                                       ds18b20_resolution_t resolution, int16_t *raw_temperature)
+{
+    ESP_RETURN_ON_FALSE(read && raw_temperature, ESP_ERR_INVALID_ARG, TAG, "invalid read or temperature pointer");
+    if (result != ESP_OK) {
+        return result; // logged by the bus already
     }
 
-    ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(handle, tx_buffer, tx_buffer_size),
-                        TAG, "error while triggering temperature convert");
+    const ds18b20_scratchpad_t *scratchpad = &read->scratchpad;
+    if (read->is_fast) {
+        if (scratchpad->temp_lsb == 0xFF && scratchpad->temp_msb == 0xFF) {
+            return ESP_ERR_INVALID_RESPONSE; // device may not have answered, checked before masking
+        }
+        *raw_temperature = ds18b20_build_raw_temperature(scratchpad->temp_lsb, scratchpad->temp_msb, resolution);
+        return ESP_OK;
+    }
 
+    if (!read->request.rx_crc_valid) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    *raw_temperature = ds18b20_scratchpad_get_raw_temperature(scratchpad);
     return ESP_OK;
 }
 
@@ -40,35 +161,45 @@ esp_err_t ds18b20_get_temperature(onewire_bus_handle_t handle, const uint8_t *ro
     ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
     ESP_RETURN_ON_FALSE(temperature, ESP_ERR_INVALID_ARG, TAG, "invalid temperature pointer");
 
-    ESP_RETURN_ON_ERROR(onewire_bus_reset(handle), TAG, "error while resetting bus"); // reset bus and check if the device is present
-
     ds18b20_scratchpad_t scratchpad;
+    ESP_RETURN_ON_ERROR(ds18b20_read_scratchpad(handle, rom_number, &scratchpad), TAG, "error while reading temperature");
+    ESP_RETURN_ON_FALSE(!ds18b20_is_power_on_value(&scratchpad), ESP_ERR_INVALID_STATE, TAG, "temperature not converted");
 
-    uint8_t tx_buffer[10];
-    uint8_t tx_buffer_size;
+    *temperature = ds18b20_scratchpad_get_temperature(&scratchpad);
 
-    if (rom_number) { // specify rom id
-        tx_buffer[0] = ONEWIRE_CMD_MATCH_ROM;
-        tx_buffer[9] = DS18B20_CMD_READ_SCRATCHPAD;
-        memcpy(&tx_buffer[1], rom_number, 8);
-        tx_buffer_size = 10;
-    } else {
-        tx_buffer[0] = ONEWIRE_CMD_SKIP_ROM;
-        tx_buffer[1] = DS18B20_CMD_READ_SCRATCHPAD;
-        tx_buffer_size = 2;
-    }
+    return ESP_OK;
+}
 
-    ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(handle, tx_buffer, tx_buffer_size),
-                        TAG, "error while sending read scratchpad command");
-    ESP_RETURN_ON_ERROR(onewire_bus_read_bytes(handle, (uint8_t *)&scratchpad, sizeof(scratchpad)),
-                        TAG, "error while reading scratchpad command");
+bool ds18b20_is_power_on_value(const ds18b20_scratchpad_t *scratchpad)
+{
+    return scratchpad->temp_msb == 0x05 && scratchpad->temp_lsb == 0x50 && scratchpad->_reserved2 == 0x0C;
+}
 
-    ESP_RETURN_ON_FALSE(onewire_check_crc8((uint8_t *)&scratchpad, 8) == scratchpad.crc_value, ESP_ERR_INVALID_CRC,
-                        TAG, "crc error");
+int16_t ds18b20_scratchpad_get_raw_temperature(const ds18b20_scratchpad_t *scratchpad)
+{
+    return ds18b20_build_raw_temperature(scratchpad->temp_lsb, scratchpad->temp_msb, scratchpad->configuration);
+}
 
-    static const uint8_t lsb_mask[4] = { 0x07, 0x03, 0x01, 0x00 };
-    uint8_t lsb_masked = scratchpad.temp_lsb & (~lsb_mask[scratchpad.configuration >> 5]); // mask bits not used in low resolution
-    *temperature = (((int16_t)scratchpad.temp_msb << 8) | lsb_masked)  / 16.0f;
+float ds18b20_scratchpad_get_temperature(const ds18b20_scratchpad_t *scratchpad)
+{
+    return ds18b20_scratchpad_get_raw_temperature(scratchpad) / 16.0f;
+}
+
+esp_err_t ds18b20_write_scratchpad(onewire_bus_handle_t handle, const uint8_t *rom_number, int8_t th, int8_t tl,
+                                   ds18b20_resolution_t resolution)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+
+    uint8_t tx_buffer[13];
+    uint8_t tx_buffer_size = ds18b20_build_command(tx_buffer, rom_number, DS18B20_CMD_WRITE_SCRATCHPAD);
+
+    tx_buffer[tx_buffer_size ++] = (uint8_t)th;
+    tx_buffer[tx_buffer_size ++] = (uint8_t)tl;
+    tx_buffer[tx_buffer_size ++] = resolution;
+
+    // reset bus, check if the device is present and write scratchpad in one transaction
+    ESP_RETURN_ON_ERROR(onewire_bus_transact(handle, tx_buffer, tx_buffer_size, NULL, 0, NULL),
+                        TAG, "error while sending write scratchpad command");
 
     return ESP_OK;
 }
@@ -77,30 +208,56 @@ esp_err_t ds18b20_set_resolution(onewire_bus_handle_t handle, const uint8_t *rom
 {
     ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
 
-    ESP_RETURN_ON_ERROR(onewire_bus_reset(handle), TAG, "error while resetting bus"); // reset bus and check if the device is present
+    int8_t th = DS18B20_ALARM_TH_DISABLED;
+    int8_t tl = DS18B20_ALARM_TL_DISABLED;
+
+    if (rom_number) { // keep alarm thresholds of the device, TH, TL and configuration can only be written together
+        ds18b20_scratchpad_t scratchpad;
+        ESP_RETURN_ON_ERROR(ds18b20_read_scratchpad(handle, rom_number, &scratchpad), TAG, "error while reading thresholds");
+        th = (int8_t)scratchpad.th_user1;
+        tl = (int8_t)scratchpad.tl_user2;
+    }
+
+    return ds18b20_write_scratchpad(handle, rom_number, th, tl, resolution);
+}
+
+esp_err_t ds18b20_copy_scratchpad(onewire_bus_handle_t handle, const uint8_t *rom_number)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
 
     uint8_t tx_buffer[10];
-    uint8_t tx_buffer_size;
+    uint8_t tx_buffer_size = ds18b20_build_command(tx_buffer, rom_number, DS18B20_CMD_COPY_SCRATCHPAD);
 
-    if (rom_number) { // specify rom id
-        tx_buffer[0] = ONEWIRE_CMD_MATCH_ROM;
-        tx_buffer[9] = DS18B20_CMD_WRITE_SCRATCHPAD;
-        memcpy(&tx_buffer[1], rom_number, 8);
-        tx_buffer_size = 10;
-    } else {
-        tx_buffer[0] = ONEWIRE_CMD_SKIP_ROM;
-        tx_buffer[1] = DS18B20_CMD_WRITE_SCRATCHPAD;
-        tx_buffer_size = 2;
+    // reset bus, check if the device is present and send copy scratchpad command in one transaction
+    ESP_RETURN_ON_ERROR(onewire_bus_transact(handle, tx_buffer, tx_buffer_size, NULL, 0, NULL),
+                        TAG, "error while sending copy scratchpad command");
+
+    // bus must not be used before EEPROM is written, round up so at least the whole write time passes
+    vTaskDelay(pdMS_TO_TICKS(DS18B20_COPY_SCRATCHPAD_TIME_MS) + 1);
+
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_configure(onewire_bus_handle_t handle, const uint8_t *rom_number, int8_t th, int8_t tl,
+                            ds18b20_resolution_t resolution)
+{
+    ESP_RETURN_ON_FALSE(handle, ESP_ERR_INVALID_ARG, TAG, "invalid 1-wire handle");
+    ESP_RETURN_ON_FALSE(rom_number, ESP_ERR_INVALID_ARG, TAG, "configuration can only be verified with rom number");
+
+    ds18b20_scratchpad_t scratchpad;
+    ESP_RETURN_ON_ERROR(ds18b20_read_scratchpad(handle, rom_number, &scratchpad), TAG, "error while reading configuration");
+    if ((int8_t)scratchpad.th_user1 == th && (int8_t)scratchpad.tl_user2 == tl && scratchpad.configuration == resolution) {
+        return ESP_OK; // already configured, keep EEPROM from wearing out
     }
 
-    ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(handle, tx_buffer, tx_buffer_size),
-                        TAG, "error while sending read scratchpad command");
+    ESP_RETURN_ON_ERROR(ds18b20_write_scratchpad(handle, rom_number, th, tl, resolution), TAG, "error while writing configuration");
 
-    tx_buffer[0] = 0;
-    tx_buffer[1] = 0;
-    tx_buffer[2] = resolution;
-    ESP_RETURN_ON_ERROR(onewire_bus_write_bytes(handle, tx_buffer, 3),
-                        TAG, "error while sending write scratchpad command");
+    // verify before committing to EEPROM, a corrupted write would otherwise survive power cycles
+    ESP_RETURN_ON_ERROR(ds18b20_read_scratchpad(handle, rom_number, &scratchpad), TAG, "error while verifying configuration");
+    ESP_RETURN_ON_FALSE((int8_t)scratchpad.th_user1 == th && (int8_t)scratchpad.tl_user2 == tl && scratchpad.configuration == resolution,
+                        ESP_ERR_INVALID_RESPONSE, TAG, "configuration read back does not match");
+
+    ESP_RETURN_ON_ERROR(ds18b20_copy_scratchpad(handle, rom_number), TAG, "error while storing configuration");
 
     return ESP_OK;
 }
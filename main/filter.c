@@ -0,0 +1,140 @@
+#include "filter.h"
+
+#include <string.h>
+
+#include "esp_err.h"
+
+#define FILTER_FRACTION_BITS 8 // extra fraction bits of EMA and Kalman state, beyond 1/16 °C
+
+// divide rounding half away from zero, integer division truncates toward zero
+static int32_t filter_divide_rounded(int32_t dividend, int32_t divisor)
+{
+    return dividend >= 0 ? (dividend + divisor / 2) / divisor : (dividend - divisor / 2) / divisor;
+}
+
+// convert a variance in 1/10000 °C² to 1/65536 °C²
+static uint32_t filter_variance_from_config(uint32_t variance)
+{
+    return (uint32_t)(((uint64_t)variance * 65536 + 5000) / 10000);
+}
+
+esp_err_t filter_init(filter_t *filter, const filter_config_t *config)
+{
+    if (filter == NULL || config == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    switch (config->type) {
+    case FILTER_TYPE_NONE:
+        break;
+    case FILTER_TYPE_MOVING_AVERAGE:
+    case FILTER_TYPE_MEDIAN:
+        if (config->window < 1 || config->window > FILTER_WINDOW_MAX) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+    case FILTER_TYPE_EMA:
+        if (config->alpha < 1 || config->alpha > 100) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+    case FILTER_TYPE_KALMAN:
+        // bounded, so sums of variances in 1/65536 °C² fit into 32 bits
+        if (config->measurement_noise < 1 || config->measurement_noise > 1000000 || config->process_noise > 1000000) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        break;
+    default:
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memset(filter, 0, sizeof(*filter));
+    filter->type = config->type;
+    filter->window = config->window;
+    if (config->type == FILTER_TYPE_EMA) {
+        filter->ema.alpha = config->alpha;
+    } else if (config->type == FILTER_TYPE_KALMAN) {
+        filter->kalman.process_noise = filter_variance_from_config(config->process_noise);
+        filter->kalman.measurement_noise = filter_variance_from_config(config->measurement_noise);
+    }
+    return ESP_OK;
+}
+
+// put reading into history ring, return the reading it replaces
+static int16_t filter_push_history(filter_t *filter, int16_t *history, int16_t reading)
+{
+    int16_t replaced = history[filter->index];
+    history[filter->index] = reading;
+    filter->index = (filter->index + 1) % filter->window;
+    if (filter->count < filter->window) {
+        filter->count++;
+        replaced = 0; // slot was empty
+    }
+    return replaced;
+}
+
+static int16_t filter_median(const filter_t *filter)
+{
+    int16_t sorted[FILTER_WINDOW_MAX];
+    memcpy(sorted, filter->median.history, filter->count * sizeof(sorted[0]));
+
+    // insertion sort, the window is small
+    for (uint8_t i = 1; i < filter->count; ++i) {
+        int16_t value = sorted[i];
+        int8_t k = i - 1;
+        while (k >= 0 && sorted[k] > value) {
+            sorted[k + 1] = sorted[k];
+            --k;
+        }
+        sorted[k + 1] = value;
+    }
+
+    uint8_t middle = filter->count / 2;
+    if (filter->count % 2 == 0) {
+        return filter_divide_rounded(sorted[middle - 1] + sorted[middle], 2); // mean of the middle two
+    }
+    return sorted[middle];
+}
+
+static int16_t filter_from_fraction(int32_t value)
+{
+    return filter_divide_rounded(value, 1 << FILTER_FRACTION_BITS);
+}
+
+int16_t filter_update(filter_t *filter, int16_t temperature)
+{
+    const int32_t reading = (int32_t)temperature * (1 << FILTER_FRACTION_BITS);
+
+    switch (filter->type) {
+    case FILTER_TYPE_MOVING_AVERAGE:
+        filter->moving_average.sum += temperature - filter_push_history(filter, filter->moving_average.history, temperature);
+        return filter_divide_rounded(filter->moving_average.sum, filter->count);
+    case FILTER_TYPE_MEDIAN:
+        filter_push_history(filter, filter->median.history, temperature);
+        return filter_median(filter);
+    case FILTER_TYPE_EMA:
+        if (filter->count == 0) {
+            filter->ema.value = reading; // start from the first reading instead of 0 °C
+            filter->count = 1;
+        } else {
+            filter->ema.value += filter_divide_rounded(filter->ema.alpha * (reading - filter->ema.value), 100);
+        }
+        return filter_from_fraction(filter->ema.value);
+    case FILTER_TYPE_KALMAN:
+        if (filter->count == 0) {
+            filter->kalman.estimate = reading;
+            filter->kalman.error = filter->kalman.measurement_noise;
+            filter->count = 1;
+        } else {
+            uint32_t error = filter->kalman.error + filter->kalman.process_noise; // predict: temperature may have drifted
+            uint32_t gain = (uint32_t)(((uint64_t)error << 16) / (error + filter->kalman.measurement_noise)); // in 1/65536
+            int64_t correction = (int64_t)gain * (reading - filter->kalman.estimate);
+            filter->kalman.estimate += (int32_t)((correction + (correction >= 0 ? 32768 : -32768)) / 65536);
+            filter->kalman.error = (uint32_t)(((uint64_t)(65536 - gain) * error) >> 16);
+        }
+        return filter_from_fraction(filter->kalman.estimate);
+    case FILTER_TYPE_NONE:
+    default:
+        return temperature;
+    }
+}
@@ -0,0 +1,105 @@
+#include "fmt.h"
+
+#include <string.h>
+
+static const uint16_t decimal_scale[FMT_TEMPERATURE_DECIMALS_MAX + 1] = { 1, 10, 100, 1000, 10000 };
+
+// write digits of value, at least min_digits with leading zeros, return number written
+static size_t fmt_unsigned(char *buffer, uint32_t value, uint8_t min_digits)
+{
+    char digits[10];
+    size_t count = 0;
+    do {
+        digits[count++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0 || count < min_digits);
+
+    for (size_t i = 0; i < count; ++i) {
+        buffer[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+// 64-bit division is a library call on 32-bit cores, so only the digits above 32 bits are divided in 64 bits
+static size_t fmt_unsigned64(char *buffer, uint64_t value)
+{
+    if (value <= UINT32_MAX) {
+        return fmt_unsigned(buffer, value, 1);
+    }
+    uint64_t high = value / 1000000000;
+    size_t length = fmt_unsigned64(buffer, high);
+    return length + fmt_unsigned(&buffer[length], (uint32_t)(value - high * 1000000000), 9);
+}
+
+size_t fmt_temperature(char *buffer, int16_t temperature, uint8_t decimals)
+{
+    if (decimals > FMT_TEMPERATURE_DECIMALS_MAX) {
+        decimals = FMT_TEMPERATURE_DECIMALS_MAX;
+    }
+
+    // scale magnitude from 1/16 °C to the last decimal place, rounding half up
+    uint32_t magnitude = temperature < 0 ? -(int32_t)temperature : temperature;
+    uint32_t scaled = (magnitude * decimal_scale[decimals] + 8) / 16;
+
+    size_t length = 0;
+    if (temperature < 0 && scaled != 0) { // no "-0.0"
+        buffer[length++] = '-';
+    }
+    length += fmt_unsigned(&buffer[length], scaled / decimal_scale[decimals], 1);
+    if (decimals > 0) {
+        buffer[length++] = '.';
+        length += fmt_unsigned(&buffer[length], scaled % decimal_scale[decimals], decimals);
+    }
+    buffer[length] = '\0';
+    return length;
+}
+
+size_t fmt_int(char *buffer, int64_t value)
+{
+    size_t length = 0;
+    uint64_t magnitude = value;
+    if (value < 0) {
+        buffer[length++] = '-';
+        magnitude = -magnitude; // also right for INT64_MIN
+    }
+    length += fmt_unsigned64(&buffer[length], magnitude);
+    buffer[length] = '\0';
+    return length;
+}
+
+void fmt_writer_init(fmt_writer_t *writer, char *buffer, size_t size)
+{
+    writer->buffer = buffer;
+    writer->size = size;
+    writer->length = 0;
+    writer->is_overflow = false;
+    buffer[0] = '\0';
+}
+
+static void fmt_write(fmt_writer_t *writer, const char *string, size_t length)
+{
+    if (writer->is_overflow || length >= writer->size - writer->length) {
+        writer->is_overflow = true;
+        return;
+    }
+    memcpy(&writer->buffer[writer->length], string, length);
+    writer->length += length;
+    writer->buffer[writer->length] = '\0';
+}
+
+void fmt_write_string(fmt_writer_t *writer, const char *string)
+{
+    fmt_write(writer, string, strlen(string));
+}
+
+void fmt_write_int(fmt_writer_t *writer, int64_t value)
+{
+    char string[FMT_INT_LENGTH_MAX];
+    fmt_write(writer, string, fmt_int(string, value));
+}
+
+void fmt_write_temperature(fmt_writer_t *writer, int16_t temperature, uint8_t decimals)
+{
+    char string[FMT_TEMPERATURE_LENGTH_MAX];
+    fmt_write(writer, string, fmt_temperature(string, temperature, decimals));
+}
@@ -0,0 +1,236 @@
+#include "history.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "esp_check.h"
+#include "esp_timer.h"
+
+#include "sdkconfig.h"
+
+static const char *TAG = "history";
+
+#define HISTORY_MINUTE_MS  (60 * 1000)
+#define HISTORY_QUARTER_MS (15 * 60 * 1000)
+
+typedef struct {
+    uint32_t uptime_ms;
+    int16_t temperature;
+} history_sample_t;
+
+typedef struct {
+    uint16_t next;  // slot to write next, the oldest one when the ring is full
+    uint16_t count;
+} history_ring_t;
+
+// bucket being filled, it goes to its ring when a reading of a later bucket comes
+typedef struct {
+    int64_t start_ms;
+    int32_t sum;
+    int16_t min;
+    int16_t max;
+    uint16_t count;
+} history_rollup_t;
+
+typedef struct {
+    history_sample_t raw[CONFIG_HISTORY_RAW_SAMPLES];
+    history_entry_t minute[CONFIG_HISTORY_MINUTE_BUCKETS];
+    history_entry_t quarter[CONFIG_HISTORY_QUARTER_BUCKETS];
+    history_ring_t raw_ring;
+    history_ring_t minute_ring;
+    history_ring_t quarter_ring;
+    history_rollup_t minute_rollup;
+    history_rollup_t quarter_rollup;
+} history_device_t;
+
+// Allocated per found device, as depths for all possible devices would not fit in RAM.
+// Only the processing task adds, the MQTT client task reads. A mutex and not a spinlock, as copying thousands
+// of entries must not keep interrupts disabled.
+static history_device_t *history[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+static SemaphoreHandle_t history_lock = NULL;
+
+// return slot to write, overwriting the oldest entry when full
+static uint16_t history_ring_push(history_ring_t *ring, uint16_t size)
+{
+    uint16_t slot = ring->next;
+    ring->next = (ring->next + 1) % size;
+    if (ring->count < size) {
+        ring->count++;
+    }
+    return slot;
+}
+
+// return slot of i-th oldest entry
+static uint16_t history_ring_slot(const history_ring_t *ring, uint16_t size, uint16_t i)
+{
+    return (ring->next + size - ring->count + i) % size;
+}
+
+static history_entry_t history_rollup_to_entry(const history_rollup_t *rollup)
+{
+    int32_t half = rollup->count / 2; // round half away from zero
+    return (history_entry_t) {
+        .uptime_ms = (uint32_t)rollup->start_ms,
+        .min = rollup->min,
+        .max = rollup->max,
+        .avg = (rollup->sum + (rollup->sum < 0 ? -half : half)) / rollup->count,
+        .count = rollup->count,
+    };
+}
+
+static void history_rollup_add(history_rollup_t *rollup, history_entry_t *buckets, history_ring_t *ring,
+                               uint16_t size, int64_t period_ms, int64_t time_ms, int16_t temperature)
+{
+    int64_t start_ms = time_ms - time_ms % period_ms;
+    if (rollup->count != 0 && rollup->start_ms != start_ms) {
+        buckets[history_ring_push(ring, size)] = history_rollup_to_entry(rollup);
+        rollup->count = 0;
+    }
+
+    if (rollup->count == 0) {
+        *rollup = (history_rollup_t) {
+            .start_ms = start_ms,
+            .min = temperature,
+            .max = temperature,
+        };
+    } else if (rollup->count == UINT16_MAX) {
+        return; // more than 72 readings a second, the bucket is representative already
+    }
+
+    if (temperature < rollup->min) {
+        rollup->min = temperature;
+    }
+    if (temperature > rollup->max) {
+        rollup->max = temperature;
+    }
+    rollup->sum += temperature;
+    rollup->count++;
+}
+
+esp_err_t history_init(void)
+{
+    history_lock = xSemaphoreCreateMutex();
+    ESP_RETURN_ON_FALSE(history_lock, ESP_ERR_NO_MEM, TAG, "no memory for lock");
+    return ESP_OK;
+}
+
+esp_err_t history_add_device(uint8_t device)
+{
+    ESP_RETURN_ON_FALSE(history_lock, ESP_ERR_INVALID_STATE, TAG, "history is not initialized");
+    ESP_RETURN_ON_FALSE(device < CONFIG_ONEWIRE_NUMBER_OF_DEVICES, ESP_ERR_INVALID_ARG, TAG, "invalid device");
+
+    history_device_t *dev = calloc(1, sizeof(history_device_t));
+    ESP_RETURN_ON_FALSE(dev, ESP_ERR_NO_MEM, TAG, "no memory for %u bytes of device %u",
+                        (unsigned)sizeof(history_device_t), device);
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    bool is_added = history[device] == NULL;
+    if (is_added) {
+        history[device] = dev;
+    }
+    xSemaphoreGive(history_lock);
+
+    if (!is_added) {
+        free(dev);
+    }
+    return ESP_OK;
+}
+
+void history_add(uint8_t device, int16_t temperature, int64_t timestamp_us)
+{
+    if (device >= CONFIG_ONEWIRE_NUMBER_OF_DEVICES || history_lock == NULL) {
+        return;
+    }
+
+    int64_t time_ms = timestamp_us / 1000;
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    history_device_t *dev = history[device];
+    if (dev == NULL) {
+        xSemaphoreGive(history_lock);
+        return; // device has no history
+    }
+    dev->raw[history_ring_push(&dev->raw_ring, CONFIG_HISTORY_RAW_SAMPLES)] = (history_sample_t) {
+        .uptime_ms = (uint32_t)time_ms,
+        .temperature = temperature,
+    };
+    history_rollup_add(&dev->minute_rollup, dev->minute, &dev->minute_ring, CONFIG_HISTORY_MINUTE_BUCKETS,
+                       HISTORY_MINUTE_MS, time_ms, temperature);
+    history_rollup_add(&dev->quarter_rollup, dev->quarter, &dev->quarter_ring, CONFIG_HISTORY_QUARTER_BUCKETS,
+                       HISTORY_QUARTER_MS, time_ms, temperature);
+    xSemaphoreGive(history_lock);
+}
+
+// age compared in uint32_t, so it is right across the wrap of uptime_ms
+static bool history_is_in_range(uint32_t now_ms, uint32_t uptime_ms, uint32_t from_ms, uint32_t to_ms)
+{
+    uint32_t age_ms = now_ms - uptime_ms;
+    return age_ms <= from_ms && age_ms >= to_ms;
+}
+
+static size_t history_get_buckets(const history_entry_t *buckets, const history_ring_t *ring, uint16_t size,
+                                  const history_rollup_t *rollup, uint32_t now_ms, uint32_t from_ms, uint32_t to_ms,
+                                  history_entry_t *entries)
+{
+    size_t count = 0;
+    for (uint16_t i = 0; i < ring->count; ++i) {
+        const history_entry_t *bucket = &buckets[history_ring_slot(ring, size, i)];
+        if (history_is_in_range(now_ms, bucket->uptime_ms, from_ms, to_ms)) {
+            entries[count++] = *bucket;
+        }
+    }
+    if (rollup->count != 0 && history_is_in_range(now_ms, (uint32_t)rollup->start_ms, from_ms, to_ms)) {
+        entries[count++] = history_rollup_to_entry(rollup);
+    }
+    return count;
+}
+
+size_t history_get(uint8_t device, history_level_t level, uint32_t from_ms, uint32_t to_ms, history_entry_t *entries)
+{
+    if (device >= CONFIG_ONEWIRE_NUMBER_OF_DEVICES || entries == NULL || history_lock == NULL) {
+        return 0;
+    }
+
+    const uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    size_t count = 0;
+
+    xSemaphoreTake(history_lock, portMAX_DELAY);
+    const history_device_t *dev = history[device];
+    if (dev == NULL) {
+        xSemaphoreGive(history_lock);
+        return 0; // device has no history
+    }
+
+    switch (level) {
+    case HISTORY_LEVEL_RAW:
+        for (uint16_t i = 0; i < dev->raw_ring.count; ++i) {
+            const history_sample_t *sample = &dev->raw[history_ring_slot(&dev->raw_ring, CONFIG_HISTORY_RAW_SAMPLES, i)];
+            if (history_is_in_range(now_ms, sample->uptime_ms, from_ms, to_ms)) {
+                entries[count++] = (history_entry_t) {
+                    .uptime_ms = sample->uptime_ms,
+                    .min = sample->temperature,
+                    .max = sample->temperature,
+                    .avg = sample->temperature,
+                    .count = 1,
+                };
+            }
+        }
+        break;
+    case HISTORY_LEVEL_MINUTE:
+        count = history_get_buckets(dev->minute, &dev->minute_ring, CONFIG_HISTORY_MINUTE_BUCKETS, &dev->minute_rollup,
+                                    now_ms, from_ms, to_ms, entries);
+        break;
+    case HISTORY_LEVEL_QUARTER:
+        count = history_get_buckets(dev->quarter, &dev->quarter_ring, CONFIG_HISTORY_QUARTER_BUCKETS, &dev->quarter_rollup,
+                                    now_ms, from_ms, to_ms, entries);
+        break;
+    default:
+        break;
+    }
+    xSemaphoreGive(history_lock);
+
+    return count;
+}
@@ -10,6 +10,13 @@
 #define DS18B20_CMD_CONVERT_TEMP 0x44
 #define DS18B20_CMD_WRITE_SCRATCHPAD 0x4E
 #define DS18B20_CMD_READ_SCRATCHPAD 0xBE
+#define DS18B20_CMD_COPY_SCRATCHPAD 0x48
+
+#define DS18B20_COPY_SCRATCHPAD_TIME_MS 10 // EEPROM write time
+#define DS18B20_CONVERSION_TIME_12B_MS 750 // maximum conversion time at 12-bit resolution, halved for each bit less
+
+#define DS18B20_ALARM_TH_DISABLED 127 // highest TH, device never alarms on high temperature
+#define DS18B20_ALARM_TL_DISABLED -128 // lowest TL, device never alarms on low temperature
 
 /**
  * @brief Structure of DS18B20's scratchpad
@@ -50,6 +57,30 @@ typedef enum {
  */
 esp_err_t ds18b20_trigger_temperature_conversion(onewire_bus_handle_t handle, const uint8_t *rom_number);
 
+/**
+ * @brief Get maximum conversion time of DS18B20 at a resolution
+ *
+ * @param[in] resolution resolution of DS18B20's temperation conversion
+ * @return conversion time in ms, rounded up
+ */
+uint32_t ds18b20_get_conversion_time_ms(ds18b20_resolution_t resolution);
+
+/**
+ * @brief Wait until temperature conversion of DS18B20 is done, by polling read time slots
+ *
+ * @note A converting DS18B20 answers read time slots with 0, so after a conversion triggered with skip ROM
+ *       the bus reads 1 only when all devices are done. This needs externally powered devices,
+ *       a device on parasite power cannot answer while converting.
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on
+ * @param[in] resolution highest resolution of the converting devices, bounds the waiting time
+ * @return
+ *         - ESP_OK                Conversion is done.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_TIMEOUT       Conversion is not done within the conversion time of the resolution.
+ */
+esp_err_t ds18b20_wait_for_conversion(onewire_bus_handle_t handle, ds18b20_resolution_t resolution);
+
 /**
  * @brief Get temperature from DS18B20
  *
@@ -61,12 +92,180 @@ esp_err_t ds18b20_trigger_temperature_conversion(onewire_bus_handle_t handle, co
  *         - ESP_ERR_INVALID_ARG   Invalid argument.
  *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
  *         - ESP_ERR_INVALID_CRC   CRC check failed.
+ *         - ESP_ERR_INVALID_STATE Temperature was not converted, the scratchpad holds the 85 Celsius power-on value.
  */
 esp_err_t ds18b20_get_temperature(onewire_bus_handle_t handle, const uint8_t *rom_number, float *temperature);
 
+/**
+ * @brief Read only the temperature bytes of DS18B20's scratchpad, the read is ended by the next bus reset
+ *
+ * @note Without the rest of the scratchpad there is no CRC, so the caller has to check if the temperature
+ *       is plausible, e.g. against the previous reading, and read the full scratchpad when in doubt.
+ *       A device that does not answer reads as all bits 1, which is reported as ESP_ERR_INVALID_RESPONSE
+ *       for any resolution, as it cannot be told from a real -0.0625 Celsius. The power-on value reads as 85 Celsius.
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on
+ * @param[in] rom_number ROM number to specify which DS18B20 to read from, NULL to skip ROM
+ * @param[in] resolution resolution of DS18B20's temperation conversion, bits it does not use are cleared
+ * @param[out] raw_temperature temperature in 1/16 Celsius
+ * @return
+ *         - ESP_OK                Read temperature success.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ *         - ESP_ERR_INVALID_RESPONSE Both temperature bytes read as 0xFF.
+ */
+esp_err_t ds18b20_read_temperature_fast(onewire_bus_handle_t handle, const uint8_t *rom_number,
+                                        ds18b20_resolution_t resolution, int16_t *raw_temperature);
+
+/**
+ * @brief Read scratchpad of DS18B20
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on
+ * @param[in] rom_number ROM number to specify which DS18B20 to read from, NULL to skip ROM
+ * @param[out] scratchpad scratchpad of DS18B20
+ * @return
+ *         - ESP_OK                Read scratchpad success.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ *         - ESP_ERR_INVALID_CRC   CRC check failed.
+ */
+esp_err_t ds18b20_read_scratchpad(onewire_bus_handle_t handle, const uint8_t *rom_number, ds18b20_scratchpad_t *scratchpad);
+
+/**
+ * @brief Asynchronous read of DS18B20's scratchpad, see ds18b20_submit_read()
+ *
+ */
+typedef struct {
+    onewire_bus_request_t request; /*!< on_done and user_ctx are set by the caller, the rest by ds18b20_submit_read() */
+    uint8_t tx_buffer[10];
+    ds18b20_scratchpad_t scratchpad; /*!< received scratchpad, only the temperature bytes of a fast read */
+    bool is_fast; /*!< only the temperature bytes are read, as by ds18b20_read_temperature_fast() */
+} ds18b20_read_request_t;
+
+/**
+ * @brief Submit a read of DS18B20's scratchpad to the request queue of the bus, this is a non-blocking function
+ *
+ * @note The read must stay valid until its on_done callback is called, ds18b20_get_read_temperature() then
+ *       gives the temperature or the error the blocking read would have returned.
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on, installed with a request queue
+ * @param[in] rom_number ROM number to specify which DS18B20 to read from, NULL to skip ROM
+ * @param[in] is_fast read only the temperature bytes, see ds18b20_read_temperature_fast()
+ * @param[in,out] read read to be submitted, with on_done set
+ * @return
+ *         - ESP_OK                Read is queued.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_INVALID_STATE 1-wire bus was installed without request queue.
+ *         - ESP_ERR_NO_MEM        Request queue is full.
+ */
+esp_err_t ds18b20_submit_read(onewire_bus_handle_t handle, const uint8_t *rom_number, bool is_fast,
+                              ds18b20_read_request_t *read);
+
+/**
+ * @brief Get temperature of a completed asynchronous read
+ *
+ * @param[in] read completed read
+ * @param[in] result result passed to the on_done callback of the read
+ * @param[in] resolution resolution of DS18B20's temperature conversion, used by a fast read, a full read takes it from the scratchpad
+ * @param[out] raw_temperature temperature in 1/16 Celsius
+ * @return
+ *         - ESP_OK                Read temperature success.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ *         - ESP_ERR_INVALID_CRC   CRC check of a full read failed.
+ *         - ESP_ERR_INVALID_RESPONSE Both temperature bytes of a fast read read as 0xFF.
+ */
+esp_err_t ds18b20_get_read_temperature(const ds18b20_read_request_t *read, esp_err_t result,
+                                       ds18b20_resolution_t resolution, int16_t *raw_temperature);
+
+/**
+ * @brief Write alarm thresholds and resolution to DS18B20's scratchpad
+ *
+ * @note DS18B20 sets its alarm flag after a conversion if temperature >= TH or temperature <= TL,
+ *       comparing the integer part only, such devices are found by ONEWIRE_CMD_ALARM_SEARCH_ROM.
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on
+ * @param[in] rom_number ROM number to specify which DS18B20 to write to, NULL to skip ROM
+ * @param[in] th high alarm threshold in Celsius, DS18B20_ALARM_TH_DISABLED to never alarm on high temperature
+ * @param[in] tl low alarm threshold in Celsius, DS18B20_ALARM_TL_DISABLED to never alarm on low temperature
+ * @param[in] resolution resolution of DS18B20's temperation conversion
+ * @return
+ *         - ESP_OK                Write scratchpad success.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ */
+esp_err_t ds18b20_write_scratchpad(onewire_bus_handle_t handle, const uint8_t *rom_number, int8_t th, int8_t tl,
+                                   ds18b20_resolution_t resolution);
+
+/**
+ * @brief Copy TH, TL and configuration from DS18B20's scratchpad to its EEPROM, they are recalled on power-on
+ *
+ * @note Blocks for the EEPROM write time, the device must be externally powered.
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on
+ * @param[in] rom_number ROM number to specify which DS18B20 to send command, NULL to skip ROM
+ * @return
+ *         - ESP_OK                Copy scratchpad success.
+ *         - ESP_ERR_INVALID_ARG   Invalid argument.
+ *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ */
+esp_err_t ds18b20_copy_scratchpad(onewire_bus_handle_t handle, const uint8_t *rom_number);
+
+/**
+ * @brief Configure alarm thresholds and resolution of a DS18B20 and keep them in its EEPROM
+ *
+ * @note The scratchpad is read first and nothing is written if the device is already configured,
+ *       so EEPROM is not worn out by configuring a device on every boot. Otherwise the scratchpad is written,
+ *       read back to verify it and copied to EEPROM.
+ *
+ * @param[in] handle 1-wire handle with DS18B20 on
+ * @param[in] rom_number ROM number to specify which DS18B20 to configure
+ * @param[in] th high alarm threshold in Celsius, DS18B20_ALARM_TH_DISABLED to never alarm on high temperature
+ * @param[in] tl low alarm threshold in Celsius, DS18B20_ALARM_TL_DISABLED to never alarm on low temperature
+ * @param[in] resolution resolution of DS18B20's temperation conversion
+ * @return
+ *         - ESP_OK                    DS18B20 is configured.
+ *         - ESP_ERR_INVALID_ARG       Invalid argument.
+ *         - ESP_ERR_NOT_FOUND         There is no device present on 1-wire bus.
+ *         - ESP_ERR_INVALID_CRC       CRC check of scratchpad failed.
+ *         - ESP_ERR_INVALID_RESPONSE  Scratchpad read back does not match what was written.
+ */
+esp_err_t ds18b20_configure(onewire_bus_handle_t handle, const uint8_t *rom_number, int8_t th, int8_t tl,
+                            ds18b20_resolution_t resolution);
+
+/**
+ * @brief Check if DS18B20's scratchpad still holds its power-on value, i.e. the device was reset after the last conversion
+ *
+ * @note The power-on temperature is 85 Celsius, which a real conversion can also return,
+ *       but then the reserved byte 6 is not 0x0C any more.
+ *
+ * @param[in] scratchpad scratchpad read from DS18B20
+ * @return true if the temperature in the scratchpad was not converted
+ */
+bool ds18b20_is_power_on_value(const ds18b20_scratchpad_t *scratchpad);
+
+/**
+ * @brief Get temperature from DS18B20's scratchpad
+ *
+ * @param[in] scratchpad scratchpad read from DS18B20
+ * @return temperature in Celsius, bits not used by the configured resolution are ignored
+ */
+float ds18b20_scratchpad_get_temperature(const ds18b20_scratchpad_t *scratchpad);
+
+/**
+ * @brief Get temperature from DS18B20's scratchpad in 1/16 Celsius
+ *
+ * @param[in] scratchpad scratchpad read from DS18B20
+ * @return temperature in 1/16 Celsius, bits not used by the configured resolution are cleared
+ */
+int16_t ds18b20_scratchpad_get_raw_temperature(const ds18b20_scratchpad_t *scratchpad);
+
 /**
  * @brief Set DS18B20's temperation conversion resolution
  *
+ * @note With rom_number, alarm thresholds of the device are read and written back unchanged.
+ *       With skip ROM, scratchpads of several devices cannot be read, so alarms are disabled instead.
+ *
  * @param[in] handle 1-wire handle with DS18B20 on
  * @param[in] rom_number ROM number to specify which DS18B20 to read from, NULL to skip ROM
  * @param[in] resolution resolution of DS18B20's temperation conversion
@@ -74,5 +273,6 @@ esp_err_t ds18b20_get_temperature(onewire_bus_handle_t handle, const uint8_t *ro
  *         - ESP_OK                Set DS18B20 resolution success.
  *         - ESP_ERR_INVALID_ARG   Invalid argument.
  *         - ESP_ERR_NOT_FOUND     There is no device present on 1-wire bus.
+ *         - ESP_ERR_INVALID_CRC   CRC check of thresholds read back failed.
  */
 esp_err_t ds18b20_set_resolution(onewire_bus_handle_t handle, const uint8_t *rom_number, ds18b20_resolution_t resolution);
@@ -0,0 +1,60 @@
+#ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_FILTER_H_
+#define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_FILTER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+#define FILTER_WINDOW_MAX 16
+
+typedef enum {
+    FILTER_TYPE_NONE,           // pass readings through
+    FILTER_TYPE_MOVING_AVERAGE, // mean of the last window readings
+    FILTER_TYPE_EMA,            // exponential moving average
+    FILTER_TYPE_MEDIAN,         // median of the last window readings, rejects single spikes
+    FILTER_TYPE_KALMAN,         // one-dimensional Kalman filter for a slowly changing temperature
+} filter_type_t;
+
+typedef struct {
+    filter_type_t type;
+    uint8_t window;             // number of readings for moving average and median, 1 to FILTER_WINDOW_MAX
+    uint8_t alpha;              // EMA weight of a new reading in %, 1 to 100
+    uint32_t process_noise;     // Kalman variance of the temperature change between readings, in 1/10000 °C²
+    uint32_t measurement_noise; // Kalman variance of a reading, in 1/10000 °C², at least 1
+} filter_config_t;
+
+// State of a filter, all in integers: readings are in 1/16 °C, which is exact for DS18B20,
+// EMA and Kalman keep 8 more fraction bits, so they do not get stuck on rounding
+typedef struct {
+    filter_type_t type;
+    uint8_t window;
+    uint8_t count;  // readings in history, up to window
+    uint8_t index;  // next history slot to overwrite
+    union {
+        struct {
+            int32_t sum; // running sum of history, so an update does not rescan it
+            int16_t history[FILTER_WINDOW_MAX];
+        } moving_average;
+        struct {
+            int16_t history[FILTER_WINDOW_MAX];
+        } median;
+        struct {
+            uint8_t alpha;
+            int32_t value; // in 1/4096 °C
+        } ema;
+        struct {
+            uint32_t process_noise;     // in 1/65536 °C²
+            uint32_t measurement_noise; // in 1/65536 °C²
+            int32_t estimate;           // in 1/4096 °C
+            uint32_t error;             // variance of estimate, in 1/65536 °C²
+        } kalman;
+    };
+} filter_t;
+
+esp_err_t filter_init(filter_t *filter, const filter_config_t *config);
+
+// Feed a reading in 1/16 °C, return filtered temperature in 1/16 °C
+int16_t filter_update(filter_t *filter, int16_t temperature);
+
+#endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_FILTER_H_
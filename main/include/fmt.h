@@ -0,0 +1,36 @@
+#ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_FMT_H_
+#define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_FMT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define FMT_TEMPERATURE_DECIMALS_MAX 4 // 1/16 °C is 0.0625 °C, so 4 decimal places are exact
+#define FMT_TEMPERATURE_LENGTH_MAX 12  // "-2048.0000" and terminating null, for any int16_t temperature
+#define FMT_INT_LENGTH_MAX 21          // "-9223372036854775808" and terminating null, for any int64_t
+
+// Bounded string being written, so messages can be built in preallocated buffers without printf
+typedef struct {
+    char *buffer;
+    size_t size;      // of buffer, including terminating null
+    size_t length;    // written so far, without terminating null
+    bool is_overflow; // something did not fit, buffer ends with what did
+} fmt_writer_t;
+
+// Write temperature in 1/16 °C as °C with up to FMT_TEMPERATURE_DECIMALS_MAX decimal places,
+// rounded half away from zero, without floating point. Buffer must hold FMT_TEMPERATURE_LENGTH_MAX characters.
+// Return length written, without terminating null.
+size_t fmt_temperature(char *buffer, int16_t temperature, uint8_t decimals);
+
+// Write value as decimal, buffer must hold FMT_INT_LENGTH_MAX characters. Return length written, without terminating null.
+size_t fmt_int(char *buffer, int64_t value);
+
+// Start writing to buffer of size characters, including terminating null, size must not be 0
+void fmt_writer_init(fmt_writer_t *writer, char *buffer, size_t size);
+
+// Append to a writer, nothing is appended if it does not fit entirely
+void fmt_write_string(fmt_writer_t *writer, const char *string);
+void fmt_write_int(fmt_writer_t *writer, int64_t value);
+void fmt_write_temperature(fmt_writer_t *writer, int16_t temperature, uint8_t decimals);
+
+#endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_FMT_H_
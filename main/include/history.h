@@ -0,0 +1,45 @@
+#ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_HISTORY_H_
+#define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_HISTORY_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+#include "esp_err.h"
+
+typedef enum {
+    HISTORY_LEVEL_RAW,     // every reading
+    HISTORY_LEVEL_MINUTE,  // 1-minute buckets
+    HISTORY_LEVEL_QUARTER, // 15-minute buckets
+} history_level_t;
+
+// A reading or a bucket of readings, for a reading min, max and avg are the temperature and count is 1
+typedef struct {
+    uint32_t uptime_ms; // esp_timer time of the reading or the start of the bucket, wraps after 49 days
+    int16_t min;        // in 1/16 °C
+    int16_t max;        // in 1/16 °C
+    int16_t avg;        // in 1/16 °C
+    uint16_t count;     // readings in the bucket
+} history_entry_t;
+
+#define HISTORY_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+// Most entries history_get() returns, the bucket being filled is returned after the full ones
+#define HISTORY_ENTRIES_MAX HISTORY_MAX(CONFIG_HISTORY_RAW_SAMPLES, \
+                                        HISTORY_MAX(CONFIG_HISTORY_MINUTE_BUCKETS, CONFIG_HISTORY_QUARTER_BUCKETS) + 1)
+
+// Create the lock, before devices are added
+esp_err_t history_init(void);
+
+// Allocate the history of a found device, 8 bytes per reading and 12 per bucket, readings of devices
+// without history are not kept
+esp_err_t history_add_device(uint8_t device);
+
+// Keep a reading in 1/16 °C, the oldest one of the device is overwritten when the buffer is full
+void history_add(uint8_t device, int16_t temperature, int64_t timestamp_us);
+
+// Copy entries of a level that are from_ms to to_ms old, oldest first, into entries with room for
+// HISTORY_ENTRIES_MAX. Return number of entries copied.
+size_t history_get(uint8_t device, history_level_t level, uint32_t from_ms, uint32_t to_ms, history_entry_t *entries);
+
+#endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_HISTORY_H_
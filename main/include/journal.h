@@ -0,0 +1,31 @@
+#ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_JOURNAL_H_
+#define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_JOURNAL_H_
+
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#include "temperature.h"
+
+// Append-only journal of readings on the "journal" flash partition, kept while the broker is not reachable.
+// Records are 32 bytes and carry the device's ROM ID, so a 256 KB partition holds 8192 readings.
+// Not thread-safe, the MQTT task is its only user.
+
+// Find the partition and continue the journal left by the previous boot
+esp_err_t journal_init(void);
+
+// Append a reading, the oldest flash sector is dropped when the journal is full
+esp_err_t journal_append(const temperature_device_t *value);
+
+// Number of readings not committed yet
+size_t journal_get_count(void);
+
+// Read up to size oldest readings not committed yet, return number read. Readings of an earlier boot have
+// timestamp_us 0, readings of devices not found in this boot are dropped with the batch.
+// Reading again without journal_commit_batch() returns the same readings.
+size_t journal_read_batch(temperature_device_t *values, size_t size);
+
+// Drop readings of the last journal_read_batch(), once the broker acknowledged them
+esp_err_t journal_commit_batch(void);
+
+#endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_JOURNAL_H_
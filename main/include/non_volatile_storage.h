@@ -1,8 +1,15 @@
 #ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_NON_VOLATILE_STORAGE_H_
 #define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_NON_VOLATILE_STORAGE_H_
 
+#include <stddef.h>
+
 #include "esp_err.h"
 
 esp_err_t nvs_init(void);
 
+// Read a blob stored with nvs_write_blob(), length is the buffer size on input and the blob size on output
+esp_err_t nvs_read_blob(const char *key, void *value, size_t *length);
+
+esp_err_t nvs_write_blob(const char *key, const void *value, size_t length);
+
 #endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_NON_VOLATILE_STORAGE_H_
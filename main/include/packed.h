@@ -0,0 +1,31 @@
+#ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_PACKED_H_
+#define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_PACKED_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "temperature.h"
+
+// Packed binary payload, all fields little-endian, decoded by tools/payload_decode.py
+//
+// header, PACKED_HEADER_SIZE bytes:
+//   0  uint8     version, PACKED_VERSION
+//   1  uint8     number of records that follow
+// record, PACKED_RECORD_SIZE bytes:
+//   0  uint8[8]  ROM ID of the device, family code first, all 0 if unknown
+//   8  uint8     device index
+//   9  uint8     resolution in bits, 9 to 12, 0 if unknown
+//   10 int16     temperature in 1/16 °C
+//   12 uint32    uptime in ms the conversion was triggered, wraps after 49 days, 0 if from an earlier boot
+//   16 int64     Unix time in ms the conversion was triggered, 0 if not synchronized yet
+#define PACKED_VERSION 1
+#define PACKED_HEADER_SIZE 2
+#define PACKED_RECORD_SIZE 24
+
+// Write header for count records, return bytes written
+size_t packed_write_header(uint8_t *buffer, uint8_t count);
+
+// Write record of a reading, info of the device may be NULL if it is unknown, return bytes written
+size_t packed_write_record(uint8_t *buffer, const temperature_device_t *value, const temperature_info_t *info);
+
+#endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_PACKED_H_
@@ -1,18 +1,108 @@
 #ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_TEMPERATURE_H_
 #define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_TEMPERATURE_H_
 
+#include <stdbool.h>
+#include <stddef.h>
+
 #include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"  // NOTE: #include "FreeRTOS.h" must appear in source files before #include "queue.h"
 
+#include "sdkconfig.h"
 #include "esp_err.h"
 
+#include "ds18b20.h"
+#include "filter.h"
+
 typedef struct {
     uint8_t device;
-    float temperature;
+    int16_t temperature; // in 1/16 °C, see temperature_to_celsius()
+    int64_t timestamp_us; // esp_timer time the conversion was triggered
+    int64_t unix_time_ms; // wall-clock time the conversion was triggered, 0 if not synchronized yet
 } temperature_device_t;
 
+typedef struct {
+    uint8_t rom_id[8];
+    ds18b20_resolution_t resolution; // configured resolution
+} temperature_info_t;
+
+typedef enum {
+    TEMPERATURE_HEALTH_OK, // last read succeeded
+    TEMPERATURE_HEALTH_BACKOFF, // last reads failed, device is skipped for some conversions
+    TEMPERATURE_HEALTH_QUARANTINED, // too many reads failed, device is read rarely
+} temperature_health_state_t;
+
+typedef struct {
+    uint32_t read_count; // successful reads
+    uint32_t crc_error_count; // failed reads with CRC error, after all retries
+    uint32_t timeout_count; // failed reads without answer from the bus or device
+    uint32_t retry_count; // immediate retries after CRC error
+    uint8_t consecutive_failures;
+    temperature_health_state_t state;
+} temperature_health_t;
+
+typedef struct {
+    uint16_t absolute; // in 1/16 °C, a temperature is published when it changed by more than this, 0 for any change
+    uint8_t percent; // and by more than this % of the last published temperature, 0 to not check
+    uint32_t heartbeat_interval; // in seconds, a temperature is published at least this often even if unchanged, 0 to not
+} temperature_deadband_t;
+
+#define TEMPERATURE_NAME_LENGTH_MAX 32 // longest device name, without terminating null
+
+// Temperatures are kept in 1/16 °C as read from DS18B20, this converts them for users that want floating point
+static inline float temperature_to_celsius(int16_t temperature)
+{
+    return temperature / 16.0f;
+}
+
 esp_err_t ds18b20_init(void);
 
-extern QueueHandle_t temperature_queue;
+// Number of devices found so far on all buses, device indices are below it
+uint8_t temperature_get_device_num(void);
+
+// Name of a device in topics: its alias if one is stored, else its ROM ID or index as selected in menuconfig.
+// It is set when the device is found and does not change until reboot, so the pointer can be kept.
+const char *temperature_get_name(uint8_t device);
+
+// Store an alias of up to TEMPERATURE_NAME_LENGTH_MAX characters, without '/', '+' or '#', as name of a device
+// from the next boot, an empty alias removes it. ESP_ERR_INVALID_STATE if another device would have the same name.
+esp_err_t temperature_set_alias(uint8_t device, const char *alias);
+
+// Get ROM ID and resolution of a device
+esp_err_t temperature_get_info(uint8_t device, temperature_info_t *info);
+
+// Find index of a device by its ROM ID, indices may differ from boot to boot
+esp_err_t temperature_find_device(const uint8_t *rom_id, uint8_t *device);
+
+// Find index of a device by its name in topics, name is not null-terminated, e.g. a topic level
+esp_err_t temperature_find_device_by_name(const char *name, size_t length, uint8_t *device);
+
+// Get read and error counters and state of a device
+esp_err_t temperature_get_health(uint8_t device, temperature_health_t *health);
+
+// Set conversion resolution of a device, it is written to the device's EEPROM before its next conversion
+// and kept in NVS for the next boot
+esp_err_t temperature_set_resolution(uint8_t device, ds18b20_resolution_t resolution);
+
+// Set when a temperature of a device is published, the next reading is published in any case
+esp_err_t temperature_set_deadband(uint8_t device, const temperature_deadband_t *deadband);
+
+esp_err_t temperature_get_deadband(uint8_t device, temperature_deadband_t *deadband);
+
+// Set filter for readings of a device, it starts over with the next reading
+esp_err_t temperature_set_filter(uint8_t device, const filter_config_t *config);
+
+#if CONFIG_ONEWIRE_ALARM_MODE
+// Set alarm thresholds of a device in °C, they are written to the device before its next conversion
+// and kept in NVS for the next boot
+esp_err_t temperature_set_alarm_thresholds(uint8_t device, int8_t alarm_high, int8_t alarm_low);
+#endif
+
+// Wait up to timeout for a device whose temperature is due to be published and take its newest temperature.
+// A device is taken once per change, however often it changed, so the publisher is never behind by more than
+// one temperature per device. Return false at timeout, or early once all temperatures of a bus sweep were taken,
+// i.e. of the devices read after one conversion. Only one task may receive.
+bool temperature_receive(temperature_device_t *value, TickType_t timeout);
+
+// Take the newest temperatures of all devices again, e.g. to publish the current state after reconnect
+void temperature_mark_all_changed(void);
 
 #endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_TEMPERATURE_H_
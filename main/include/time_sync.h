@@ -0,0 +1,16 @@
+#ifndef ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_TIME_SYNC_H_
+#define ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_TIME_SYNC_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+
+esp_err_t time_sync_init(void);
+
+bool time_sync_is_synced(void);
+
+// Wall-clock time in ms since the Unix epoch, 0 until it is synchronized by SNTP
+int64_t time_sync_get_unix_time_ms(void);
+
+#endif  // ESP32_WIFI_ONEWIRE_MQTT_MAIN_INCLUDE_TIME_SYNC_H_
@@ -0,0 +1,207 @@
+#include "journal.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+
+static const char *TAG = "journal";
+
+#define JOURNAL_PARTITION_LABEL "journal"
+#define JOURNAL_SECTOR_SIZE 4096
+
+// A record is written once, after that only bits of its state are cleared, which flash allows without erasing,
+// so a sector is erased only when the journal wraps into it
+#define JOURNAL_STATE_EMPTY     0xFF // erased flash
+#define JOURNAL_STATE_WRITTEN   0xF0 // reading waits for the broker
+#define JOURNAL_STATE_COMMITTED 0x00 // broker acknowledged the reading
+
+typedef struct {
+    uint8_t state;
+    uint8_t crc;           // of temperature to the end, a write cut by reset does not match it
+    int16_t temperature;
+    uint32_t sequence;     // increments with every record, orders records after the journal wrapped
+    uint8_t rom_id[8];     // device indices may differ after reboot, so the device is found by ROM ID on replay
+    int64_t unix_time_ms;
+    int64_t timestamp_us;  // esp_timer time, only meaningful in the boot it was written in
+} journal_record_t;
+
+_Static_assert(sizeof(journal_record_t) == 32, "record must not have padding, it is covered by CRC");
+_Static_assert(JOURNAL_SECTOR_SIZE % sizeof(journal_record_t) == 0, "records must not cross sectors");
+
+#define JOURNAL_RECORDS_PER_SECTOR (JOURNAL_SECTOR_SIZE / sizeof(journal_record_t))
+
+static const esp_partition_t *partition = NULL;
+static size_t slot_num;        // records the partition holds
+static size_t head;            // slot to write next
+static size_t tail;            // oldest slot not committed
+static size_t count;           // slots from tail to head
+static size_t batch_slots;     // slots covered by the last journal_read_batch()
+static uint32_t next_sequence;
+static uint32_t boot_sequence; // first sequence written in this boot
+
+static uint8_t journal_record_crc(const journal_record_t *record)
+{
+    return esp_rom_crc8_le(0, (const uint8_t *)&record->temperature,
+                           sizeof(*record) - offsetof(journal_record_t, temperature));
+}
+
+static esp_err_t journal_read_record(size_t slot, journal_record_t *record)
+{
+    return esp_partition_read(partition, slot * sizeof(*record), record, sizeof(*record));
+}
+
+static bool journal_is_valid(const journal_record_t *record)
+{
+    return record->state != JOURNAL_STATE_EMPTY && record->crc == journal_record_crc(record);
+}
+
+esp_err_t journal_init(void)
+{
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, JOURNAL_PARTITION_LABEL);
+    ESP_RETURN_ON_FALSE(partition, ESP_ERR_NOT_FOUND, TAG, "no \"%s\" partition", JOURNAL_PARTITION_LABEL);
+    ESP_RETURN_ON_FALSE(partition->size >= 2 * JOURNAL_SECTOR_SIZE && partition->size % JOURNAL_SECTOR_SIZE == 0,
+                        ESP_ERR_INVALID_SIZE, TAG, "partition must be at least two whole sectors");
+    slot_num = partition->size / sizeof(journal_record_t);
+
+    // newest record gives head, oldest written one gives tail
+    bool is_empty = true;
+    bool is_written = false;
+    uint32_t newest_sequence = 0;
+    uint32_t oldest_written_sequence = 0;
+    journal_record_t record;
+    for (size_t slot = 0; slot < slot_num; ++slot) {
+        ESP_RETURN_ON_ERROR(journal_read_record(slot, &record), TAG, "error while scanning");
+        if (!journal_is_valid(&record)) {
+            continue;
+        }
+        if (is_empty || (int32_t)(record.sequence - newest_sequence) > 0) {
+            newest_sequence = record.sequence;
+            head = (slot + 1) % slot_num;
+            is_empty = false;
+        }
+        if (record.state == JOURNAL_STATE_WRITTEN &&
+            (!is_written || (int32_t)(record.sequence - oldest_written_sequence) < 0)) {
+            oldest_written_sequence = record.sequence;
+            tail = slot;
+            is_written = true;
+        }
+    }
+
+    next_sequence = is_empty ? 0 : newest_sequence + 1;
+    boot_sequence = next_sequence;
+    if (!is_written) {
+        tail = head;
+    }
+
+    // the slot after the newest record may hold a cut write, continue on a fresh sector then
+    if (head % JOURNAL_RECORDS_PER_SECTOR != 0) {
+        ESP_RETURN_ON_ERROR(journal_read_record(head, &record), TAG, "error while scanning");
+        if (record.state != JOURNAL_STATE_EMPTY) { // rest of the sector was erased before, so it is not a valid record
+            if (tail == head) {
+                tail = (head + JOURNAL_RECORDS_PER_SECTOR - head % JOURNAL_RECORDS_PER_SECTOR) % slot_num;
+            }
+            head = (head + JOURNAL_RECORDS_PER_SECTOR - head % JOURNAL_RECORDS_PER_SECTOR) % slot_num;
+        }
+    }
+    count = (head + slot_num - tail) % slot_num;
+    if (count == 0 && is_written) {
+        count = slot_num; // full, head is on tail
+    }
+
+    ESP_LOGI(TAG, "journal_init() finished, %u of %u readings to replay", (unsigned)count, (unsigned)slot_num);
+    return ESP_OK;
+}
+
+esp_err_t journal_append(const temperature_device_t *value)
+{
+    ESP_RETURN_ON_FALSE(partition, ESP_ERR_INVALID_STATE, TAG, "journal is not initialized");
+    ESP_RETURN_ON_FALSE(value, ESP_ERR_INVALID_ARG, TAG, "invalid value pointer");
+
+    temperature_info_t info;
+    ESP_RETURN_ON_ERROR(temperature_get_info(value->device, &info), TAG, "unknown device %u", value->device);
+
+    if (head % JOURNAL_RECORDS_PER_SECTOR == 0) {
+        // entering the oldest sector, readings still in it are lost
+        size_t sector_end = head + JOURNAL_RECORDS_PER_SECTOR;
+        if (count != 0 && tail >= head && tail < sector_end) {
+            ESP_LOGW(TAG, "Journal is full, %u oldest readings dropped", (unsigned)(sector_end - tail));
+            count -= sector_end - tail;
+            tail = sector_end % slot_num;
+            batch_slots = 0;
+        }
+        ESP_RETURN_ON_ERROR(esp_partition_erase_range(partition, head * sizeof(journal_record_t), JOURNAL_SECTOR_SIZE),
+                            TAG, "error while erasing sector");
+    }
+
+    journal_record_t record = {
+        .state = JOURNAL_STATE_WRITTEN,
+        .sequence = next_sequence,
+        .unix_time_ms = value->unix_time_ms,
+        .timestamp_us = value->timestamp_us,
+        .temperature = value->temperature,
+    };
+    memcpy(record.rom_id, info.rom_id, sizeof(record.rom_id));
+    record.crc = journal_record_crc(&record);
+    ESP_RETURN_ON_ERROR(esp_partition_write(partition, head * sizeof(record), &record, sizeof(record)),
+                        TAG, "error while writing reading");
+
+    next_sequence++;
+    head = (head + 1) % slot_num;
+    count++;
+    return ESP_OK;
+}
+
+size_t journal_get_count(void)
+{
+    return count;
+}
+
+size_t journal_read_batch(temperature_device_t *values, size_t size)
+{
+    size_t read = 0;
+    batch_slots = 0;
+    while (read < size && batch_slots < count) {
+        journal_record_t record;
+        if (journal_read_record((tail + batch_slots) % slot_num, &record) != ESP_OK) {
+            break;
+        }
+        batch_slots++;
+        if (!journal_is_valid(&record) || record.state != JOURNAL_STATE_WRITTEN) {
+            continue; // cut write or committed before a reset, nothing to replay
+        }
+        uint8_t device;
+        if (temperature_find_device(record.rom_id, &device) != ESP_OK) {
+            ESP_LOGW(TAG, "Dropped reading of device " ONEWIRE_ROM_ID_STR " not found in this boot",
+                     ONEWIRE_ROM_ID(record.rom_id));
+            continue;
+        }
+
+        values[read++] = (temperature_device_t) {
+            .device = device,
+            .temperature = record.temperature,
+            .timestamp_us = (int32_t)(record.sequence - boot_sequence) >= 0 ? record.timestamp_us : 0,
+            .unix_time_ms = record.unix_time_ms,
+        };
+    }
+    return read;
+}
+
+esp_err_t journal_commit_batch(void)
+{
+    ESP_RETURN_ON_FALSE(partition, ESP_ERR_INVALID_STATE, TAG, "journal is not initialized");
+
+    static const uint8_t state = JOURNAL_STATE_COMMITTED; // clears the state byte only, CRC and reading stay intact
+    for (; batch_slots > 0; --batch_slots) {
+        ESP_RETURN_ON_ERROR(esp_partition_write(partition, tail * sizeof(journal_record_t), &state, sizeof(state)),
+                            TAG, "error while committing reading");
+        tail = (tail + 1) % slot_num;
+        count--;
+    }
+    return ESP_OK;
+}
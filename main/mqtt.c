@@ -1,19 +1,24 @@
 #include "mqtt.h"
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
-#include "freertos/queue.h"
 #include "freertos/event_groups.h"
 
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "mqtt_client.h"
 
+#include "fmt.h"
+#include "history.h"
+#include "journal.h"
 #include "led.h"
+#include "packed.h"
 #include "temperature.h"
 #include "types.h"
 
@@ -26,10 +31,42 @@ typedef enum {
 
 static const char TOPIC_LED_SWITCH[]  = CONFIG_BROKER_TOPIC_PREFIX "/led_switch";
 static const char TOPIC_LED_STATUS[]  = CONFIG_BROKER_TOPIC_PREFIX "/led_status";
-static const char TOPIC_TEMPERATURE[] = CONFIG_BROKER_TOPIC_PREFIX "/temperature/device_";
+#if CONFIG_BROKER_PUBLISH_BATCH
+static const char TOPIC_BATCH[]       = CONFIG_BROKER_TOPIC_PREFIX "/temperature/batch";
+#else
+static const char TOPIC_TEMPERATURE[] = CONFIG_BROKER_TOPIC_PREFIX "/temperature/";
+#endif
+static const char TOPIC_HEALTH[]      = CONFIG_BROKER_TOPIC_PREFIX "/health/";
+static const char TOPIC_JOURNAL[]     = CONFIG_BROKER_TOPIC_PREFIX "/journal/";
+static const char TOPIC_DEADBAND[]    = CONFIG_BROKER_TOPIC_PREFIX "/deadband/";
+static const char TOPIC_ALIAS[]       = CONFIG_BROKER_TOPIC_PREFIX "/alias/";
+static const char TOPIC_FILTER[]      = CONFIG_BROKER_TOPIC_PREFIX "/filter/";
+static const char TOPIC_RESOLUTION[]  = CONFIG_BROKER_TOPIC_PREFIX "/resolution/";
+#if CONFIG_ONEWIRE_ALARM_MODE
+static const char TOPIC_ALARM[]       = CONFIG_BROKER_TOPIC_PREFIX "/alarm/";
+#endif
+static const char TOPIC_HISTORY_REQUEST[]  = CONFIG_BROKER_TOPIC_PREFIX "/history/request/";
+static const char TOPIC_HISTORY_RESPONSE[] = CONFIG_BROKER_TOPIC_PREFIX "/history/response/";
+
+#define HISTORY_ENTRIES_PER_MESSAGE 32
+
+// frames of the publish path take under 400 bytes on the host, payloads are static, the rest is for a log line,
+// a journal write to flash or esp-mqtt writing to the transport, one at a time, check STACK_MIN of task_monitor
+#define MQTT_TASK_STACK_SIZE 4096
 
 static TaskHandle_t mqtt_task_handle = NULL;
 
+static volatile bool is_connected = false;
+
+// journal batch being replayed, readings are committed when the broker acknowledged all its messages
+static portMUX_TYPE replay_lock = portMUX_INITIALIZER_UNLOCKED;
+static int replay_msg_ids[CONFIG_JOURNAL_REPLAY_BATCH];
+static size_t replay_size = 0;    // messages in the batch, 0 if no batch is replayed
+static size_t replay_pending = 0; // messages of the batch not acknowledged yet
+#define REPLAY_EARLY_IDS_SIZE (CONFIG_JOURNAL_REPLAY_BATCH * 2)
+static int replay_early_ids[REPLAY_EARLY_IDS_SIZE]; // acknowledged before replay_journal() stored the msg_id
+static size_t replay_early_next = 0;
+
 static void log_error_if_nonzero(const char *message, int error_code)
 {
     if (error_code != 0) {
@@ -42,12 +79,295 @@ static inline bool is_event_group_created(EventGroupHandle_t event)
     return event != NULL ? true : false;
 }
 
+// check if topic of an event is topic, or starts with it if is_prefix
+static bool is_topic(esp_mqtt_event_handle_t event, const char *topic, bool is_prefix)
+{
+    size_t length = strlen(topic);
+    size_t topic_length = event->topic_len;
+    return (is_prefix ? topic_length > length : topic_length == length) &&
+           memcmp(event->topic, topic, length) == 0;
+}
+
+// find device named after topic, e.g. kitchen of <topic>kitchen, return false if no device has the name
+static bool get_topic_device(esp_mqtt_event_handle_t event, const char *topic, uint8_t *device)
+{
+    size_t length = strlen(topic);
+    return temperature_find_device_by_name(event->topic + length, event->topic_len - length, device) == ESP_OK;
+}
+
+// payload "<deadband in 1/100 °C> <deadband in %> <heartbeat interval in s>", same units as in menuconfig
+static void handle_deadband(esp_mqtt_event_handle_t event)
+{
+    char string[32];
+    if ((size_t)event->data_len >= sizeof(string)) {
+        ESP_LOGW(TAG, "Invalid deadband message");
+        return;
+    }
+
+    uint8_t device;
+    if (!get_topic_device(event, TOPIC_DEADBAND, &device)) {
+        ESP_LOGW(TAG, "Invalid deadband device");
+        return;
+    }
+
+    unsigned absolute, percent;
+    unsigned long heartbeat_interval;
+    memcpy(string, event->data, event->data_len);
+    string[event->data_len] = '\0';
+    if (sscanf(string, "%u %u %lu", &absolute, &percent, &heartbeat_interval) != 3 ||
+        absolute > 10000 || percent > 100) {
+        ESP_LOGW(TAG, "Invalid deadband \"%s\"", string);
+        return;
+    }
+
+    temperature_deadband_t deadband = {
+        .absolute = absolute * 16 / 100, // 1/100 °C to 1/16 °C, rounded down
+        .percent = percent,
+        .heartbeat_interval = heartbeat_interval,
+    };
+    esp_err_t status = temperature_set_deadband(device, &deadband);
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set deadband of device %s: %s", temperature_get_name(device), esp_err_to_name(status));
+    }
+}
+
+// payload is the alias used as device name in topics from the next boot, empty to use the default name again
+static void handle_alias(esp_mqtt_event_handle_t event)
+{
+    char alias[TEMPERATURE_NAME_LENGTH_MAX + 1];
+    uint8_t device;
+    if ((size_t)event->data_len >= sizeof(alias) || !get_topic_device(event, TOPIC_ALIAS, &device)) {
+        ESP_LOGW(TAG, "Invalid alias message");
+        return;
+    }
+
+    memcpy(alias, event->data, event->data_len);
+    alias[event->data_len] = '\0';
+    esp_err_t status = temperature_set_alias(device, alias);
+    if (status == ESP_ERR_INVALID_STATE) {
+        ESP_LOGW(TAG, "Alias \"%s\" of device %s is the name of another device", alias, temperature_get_name(device));
+        return;
+    }
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set alias \"%s\" of device %s: %s", alias, temperature_get_name(device), esp_err_to_name(status));
+        return;
+    }
+    ESP_LOGI(TAG, "Alias \"%s\" of device %s is used from the next boot", alias, temperature_get_name(device));
+}
+
+static const char *const filter_type_names[] = {
+    [FILTER_TYPE_NONE] = "none",
+    [FILTER_TYPE_MOVING_AVERAGE] = "average",
+    [FILTER_TYPE_EMA] = "ema",
+    [FILTER_TYPE_MEDIAN] = "median",
+    [FILTER_TYPE_KALMAN] = "kalman",
+};
+
+// payload "none", "average <window>", "median <window>", "ema <weight of a new reading in %>" or
+// "kalman <process noise> <measurement noise>" in 1/10000 °C², same units as in menuconfig
+static void handle_filter(esp_mqtt_event_handle_t event)
+{
+    static const int filter_type_fields[] = {
+        [FILTER_TYPE_NONE] = 1,
+        [FILTER_TYPE_MOVING_AVERAGE] = 2,
+        [FILTER_TYPE_EMA] = 2,
+        [FILTER_TYPE_MEDIAN] = 2,
+        [FILTER_TYPE_KALMAN] = 3,
+    };
+    char string[40];
+    char type_name[8];
+    uint8_t device;
+    unsigned first = 0, second = 0;
+
+    if ((size_t)event->data_len >= sizeof(string) || !get_topic_device(event, TOPIC_FILTER, &device)) {
+        ESP_LOGW(TAG, "Invalid filter message");
+        return;
+    }
+    memcpy(string, event->data, event->data_len);
+    string[event->data_len] = '\0';
+    int fields = sscanf(string, "%7s %u %u", type_name, &first, &second);
+
+    filter_type_t type = FILTER_TYPE_NONE;
+    while (fields > 0 && type <= FILTER_TYPE_KALMAN && strcmp(type_name, filter_type_names[type]) != 0) {
+        ++type;
+    }
+    if (fields <= 0 || type > FILTER_TYPE_KALMAN || fields != filter_type_fields[type] ||
+        (type != FILTER_TYPE_KALMAN && first > UINT8_MAX)) {
+        ESP_LOGW(TAG, "Invalid filter \"%s\"", string);
+        return;
+    }
+
+    filter_config_t config = {
+        .type = type,
+        .window = first,
+        .alpha = first,
+        .process_noise = first,
+        .measurement_noise = second,
+    };
+    esp_err_t status = temperature_set_filter(device, &config); // ranges are checked by the filter itself
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set filter \"%s\" of device %s: %s", string, temperature_get_name(device), esp_err_to_name(status));
+    }
+}
+
+// payload is the resolution in bits, 9 to 12, kept in NVS and in the device
+static void handle_resolution(esp_mqtt_event_handle_t event)
+{
+    static const ds18b20_resolution_t resolutions[] = {
+        DS18B20_RESOLUTION_9B, DS18B20_RESOLUTION_10B, DS18B20_RESOLUTION_11B, DS18B20_RESOLUTION_12B,
+    };
+    char string[8];
+    uint8_t device;
+    unsigned bits;
+
+    if ((size_t)event->data_len >= sizeof(string) || !get_topic_device(event, TOPIC_RESOLUTION, &device)) {
+        ESP_LOGW(TAG, "Invalid resolution message");
+        return;
+    }
+    memcpy(string, event->data, event->data_len);
+    string[event->data_len] = '\0';
+    if (sscanf(string, "%u", &bits) != 1 || bits < 9 || bits > 12) {
+        ESP_LOGW(TAG, "Invalid resolution \"%s\"", string);
+        return;
+    }
+
+    esp_err_t status = temperature_set_resolution(device, resolutions[bits - 9]);
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set resolution of device %s: %s", temperature_get_name(device), esp_err_to_name(status));
+    }
+}
+
+#if CONFIG_ONEWIRE_ALARM_MODE
+// payload "<high threshold in °C> <low threshold in °C>", 127 and -128 never alarm, kept in NVS and in the device
+static void handle_alarm(esp_mqtt_event_handle_t event)
+{
+    char string[16];
+    uint8_t device;
+    int alarm_high, alarm_low;
+
+    if ((size_t)event->data_len >= sizeof(string) || !get_topic_device(event, TOPIC_ALARM, &device)) {
+        ESP_LOGW(TAG, "Invalid alarm message");
+        return;
+    }
+    memcpy(string, event->data, event->data_len);
+    string[event->data_len] = '\0';
+    if (sscanf(string, "%d %d", &alarm_high, &alarm_low) != 2 ||
+        alarm_high > INT8_MAX || alarm_low < INT8_MIN || alarm_low > alarm_high) {
+        ESP_LOGW(TAG, "Invalid alarm thresholds \"%s\"", string);
+        return;
+    }
+
+    esp_err_t status = temperature_set_alarm_thresholds(device, alarm_high, alarm_low);
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to set alarm thresholds of device %s: %s", temperature_get_name(device), esp_err_to_name(status));
+    }
+}
+#endif
+
+static const char *const history_level_names[] = {
+    [HISTORY_LEVEL_RAW] = "raw",
+    [HISTORY_LEVEL_MINUTE] = "minute",
+    [HISTORY_LEVEL_QUARTER] = "quarter",
+};
+
+// write one message of history entries, raw readings as [uptime_ms,temperature],
+// buckets as [uptime_ms,min,max,avg,count], return length
+static size_t history_to_json(char *string, size_t size, history_level_t level, uint32_t now_ms,
+                              size_t part, size_t parts, const history_entry_t *entries, size_t count)
+{
+    int length = snprintf(string, size, "{\"level\":\"%s\",\"now_uptime_ms\":%lu,\"part\":%u,\"parts\":%u,\"entries\":[",
+                          history_level_names[level], (unsigned long)now_ms, (unsigned)part, (unsigned)parts);
+    for (size_t i = 0; i < count && length > 0 && (size_t)length < size; ++i) {
+        char min[FMT_TEMPERATURE_LENGTH_MAX];
+        fmt_temperature(min, entries[i].min, FMT_TEMPERATURE_DECIMALS_MAX);
+        if (level == HISTORY_LEVEL_RAW) {
+            length += snprintf(string + length, size - length, "%s[%lu,%s]", i == 0 ? "" : ",",
+                               (unsigned long)entries[i].uptime_ms, min);
+        } else {
+            char max[FMT_TEMPERATURE_LENGTH_MAX];
+            char avg[FMT_TEMPERATURE_LENGTH_MAX];
+            fmt_temperature(max, entries[i].max, FMT_TEMPERATURE_DECIMALS_MAX);
+            fmt_temperature(avg, entries[i].avg, FMT_TEMPERATURE_DECIMALS_MAX);
+            length += snprintf(string + length, size - length, "%s[%lu,%s,%s,%s,%u]", i == 0 ? "" : ",",
+                               (unsigned long)entries[i].uptime_ms, min, max, avg, entries[i].count);
+        }
+    }
+    if (length > 0 && (size_t)length < size) {
+        length += snprintf(string + length, size - length, "]}");
+    }
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+// payload "<raw|minute|quarter> <from s ago> [<to s ago>]" on the topic of the device, answered in messages
+// of HISTORY_ENTRIES_PER_MESSAGE entries, oldest first
+static void handle_history_request(esp_mqtt_event_handle_t event)
+{
+    // runs on the MQTT client task only, too big for its stack
+    static history_entry_t entries[HISTORY_ENTRIES_MAX];
+    static char string[96 + HISTORY_ENTRIES_PER_MESSAGE * 64]; // header and entries of 5 numbers
+    char request[32];
+    char level_name[8];
+    uint8_t device;
+    unsigned long from_s, to_s = 0;
+
+    if ((size_t)event->data_len >= sizeof(request) || !get_topic_device(event, TOPIC_HISTORY_REQUEST, &device)) {
+        ESP_LOGW(TAG, "Invalid history request");
+        return;
+    }
+    memcpy(request, event->data, event->data_len);
+    request[event->data_len] = '\0';
+    if (sscanf(request, "%7s %lu %lu", level_name, &from_s, &to_s) < 2 || to_s > from_s || from_s > UINT32_MAX / 1000) {
+        ESP_LOGW(TAG, "Invalid history request \"%s\"", request);
+        return;
+    }
+
+    history_level_t level = HISTORY_LEVEL_RAW;
+    while (level <= HISTORY_LEVEL_QUARTER && strcmp(level_name, history_level_names[level]) != 0) {
+        ++level;
+    }
+    if (level > HISTORY_LEVEL_QUARTER) {
+        ESP_LOGW(TAG, "Invalid history level \"%s\"", level_name);
+        return;
+    }
+
+    uint32_t now_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    size_t count = history_get(device, level, from_s * 1000, to_s * 1000, entries);
+    size_t parts = count == 0 ? 1 : (count + HISTORY_ENTRIES_PER_MESSAGE - 1) / HISTORY_ENTRIES_PER_MESSAGE;
+
+    char topic[sizeof(TOPIC_HISTORY_RESPONSE) + TEMPERATURE_NAME_LENGTH_MAX];
+    fmt_writer_t writer;
+    fmt_writer_init(&writer, topic, sizeof(topic));
+    fmt_write_string(&writer, TOPIC_HISTORY_RESPONSE);
+    fmt_write_string(&writer, temperature_get_name(device));
+    for (size_t part = 0; part < parts; ++part) {
+        size_t first = part * HISTORY_ENTRIES_PER_MESSAGE;
+        size_t part_count = count - first < HISTORY_ENTRIES_PER_MESSAGE ? count - first : HISTORY_ENTRIES_PER_MESSAGE;
+        if (history_to_json(string, sizeof(string), level, now_ms, part, parts, &entries[first], part_count) != 0) {
+            esp_mqtt_client_publish(event->client, topic, string, 0, 0, MQTT_RETAIN_FALSE);
+        }
+    }
+}
+
 static void handle_data(void *event_data)
 {
     esp_mqtt_event_handle_t event = event_data;
     esp_mqtt_client_handle_t client = event->client;
-    
-    if (*(event->topic) == *TOPIC_LED_SWITCH) {
+
+    if (is_topic(event, TOPIC_DEADBAND, true)) {
+        handle_deadband(event);
+    } else if (is_topic(event, TOPIC_ALIAS, true)) {
+        handle_alias(event);
+    } else if (is_topic(event, TOPIC_FILTER, true)) {
+        handle_filter(event);
+    } else if (is_topic(event, TOPIC_RESOLUTION, true)) {
+        handle_resolution(event);
+#if CONFIG_ONEWIRE_ALARM_MODE
+    } else if (is_topic(event, TOPIC_ALARM, true)) {
+        handle_alarm(event);
+#endif
+    } else if (is_topic(event, TOPIC_HISTORY_REQUEST, true)) {
+        handle_history_request(event);
+    } else if (is_topic(event, TOPIC_LED_SWITCH, false)) {
         //xEventGroupSetBits(led_event_group, LED_EVENT_BLINK);
         if (*(event->data) == '1') {
             if (is_event_group_created(led_event_group)) {
@@ -83,14 +403,38 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     int msg_id;
     switch ((esp_mqtt_event_id_t)event_id) {
     case MQTT_EVENT_CONNECTED:
-        vTaskResume(mqtt_task_handle);
+        is_connected = true;
+        temperature_mark_all_changed(); // publish current state first, journaled readings follow
         ESP_LOGI(TAG, "MQTT_EVENT_CONNECTED");
 
         msg_id = esp_mqtt_client_subscribe(client, TOPIC_LED_SWITCH, 0);
         ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
+
+        msg_id = esp_mqtt_client_subscribe(client, CONFIG_BROKER_TOPIC_PREFIX "/deadband/+", 0);
+        ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
+
+        msg_id = esp_mqtt_client_subscribe(client, CONFIG_BROKER_TOPIC_PREFIX "/alias/+", 0);
+        ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
+
+        msg_id = esp_mqtt_client_subscribe(client, CONFIG_BROKER_TOPIC_PREFIX "/filter/+", 0);
+        ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
+
+        msg_id = esp_mqtt_client_subscribe(client, CONFIG_BROKER_TOPIC_PREFIX "/resolution/+", 0);
+        ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
+
+#if CONFIG_ONEWIRE_ALARM_MODE
+        msg_id = esp_mqtt_client_subscribe(client, CONFIG_BROKER_TOPIC_PREFIX "/alarm/+", 0);
+        ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
+#endif
+
+        msg_id = esp_mqtt_client_subscribe(client, CONFIG_BROKER_TOPIC_PREFIX "/history/request/+", 0);
+        ESP_LOGI(TAG, "Sent subscribe successful, msg_id=%d", msg_id);
         break;
     case MQTT_EVENT_DISCONNECTED:
-        vTaskSuspend(mqtt_task_handle);
+        is_connected = false;
+        portENTER_CRITICAL(&replay_lock);
+        replay_size = 0; // replayed again after reconnect, the broker may get some readings twice
+        portEXIT_CRITICAL(&replay_lock);
         ESP_LOGI(TAG, "MQTT_EVENT_DISCONNECTED");
         break;
 
@@ -102,6 +446,21 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
         break;
     case MQTT_EVENT_PUBLISHED:
         ESP_LOGI(TAG, "MQTT_EVENT_PUBLISHED, msg_id=%d", event->msg_id);
+        portENTER_CRITICAL(&replay_lock);
+        if (replay_size != 0) {
+            size_t i = 0;
+            while (i < replay_size && replay_msg_ids[i] != event->msg_id) {
+                ++i;
+            }
+            if (i < replay_size) {
+                replay_msg_ids[i] = -1;
+                replay_pending--;
+            } else {
+                replay_early_ids[replay_early_next] = event->msg_id;
+                replay_early_next = (replay_early_next + 1) % REPLAY_EARLY_IDS_SIZE;
+            }
+        }
+        portEXIT_CRITICAL(&replay_lock);
         break;
     case MQTT_EVENT_DATA:
         ESP_LOGI(TAG, "MQTT_EVENT_DATA");
@@ -125,43 +484,353 @@ static void mqtt_event_handler(void *handler_args, esp_event_base_t base, int32_
     }
 }
 
-static const char* float_to_string(float number, char *string)
+#if CONFIG_BROKER_PAYLOAD_PACKED
+// write a message of one record, return length
+static size_t temperature_to_packed(const temperature_device_t *value, uint8_t *buffer)
+{
+    temperature_info_t info;
+    bool is_info = temperature_get_info(value->device, &info) == ESP_OK;
+    size_t length = packed_write_header(buffer, 1);
+    return length + packed_write_record(&buffer[length], value, is_info ? &info : NULL);
+}
+#else
+// {"temperature":-55.0,"uptime_us":...,"time_ms":...,"latency_ms":...}
+#define JSON_PAYLOAD_SIZE 128
+
+// write fields of a reading without braces, uptime and latency are left out for a reading of an earlier boot,
+// which has timestamp_us 0
+static void temperature_fields_to_json(fmt_writer_t *writer, const temperature_device_t *value)
+{
+    fmt_write_string(writer, "\"temperature\":");
+    fmt_write_temperature(writer, value->temperature, 1);
+    if (value->timestamp_us != 0) {
+        fmt_write_string(writer, ",\"uptime_us\":");
+        fmt_write_int(writer, value->timestamp_us);
+    }
+    if (value->unix_time_ms != 0) {
+        fmt_write_string(writer, ",\"time_ms\":");
+        fmt_write_int(writer, value->unix_time_ms);
+    }
+    if (value->timestamp_us != 0) {
+        // latency from conversion trigger to publishing, includes time spent in queues and while disconnected
+        fmt_write_string(writer, ",\"latency_ms\":");
+        fmt_write_int(writer, (esp_timer_get_time() - value->timestamp_us) / 1000);
+    }
+}
+
+// return length, 0 if it does not fit
+static size_t temperature_to_json(const temperature_device_t *value, char *string, size_t size)
+{
+    fmt_writer_t writer;
+    fmt_writer_init(&writer, string, size);
+    fmt_write_string(&writer, "{");
+    temperature_fields_to_json(&writer, value);
+    fmt_write_string(&writer, "}");
+    return writer.is_overflow ? 0 : writer.length;
+}
+#endif
+
+static const char* health_state_to_string(temperature_health_state_t state)
+{
+    switch (state) {
+    case TEMPERATURE_HEALTH_OK:
+        return "ok";
+    case TEMPERATURE_HEALTH_BACKOFF:
+        return "backoff";
+    case TEMPERATURE_HEALTH_QUARANTINED:
+        return "quarantined";
+    default:
+        return "unknown";
+    }
+}
+
+static void publish_health(esp_mqtt_client_handle_t client)
+{
+    const uint8_t device_num = temperature_get_device_num();
+    for (uint8_t device = 0; device < device_num; ++device) {
+        temperature_health_t health;
+        if (temperature_get_health(device, &health) != ESP_OK) {
+            continue;
+        }
+
+        char topic[sizeof(TOPIC_HEALTH) + TEMPERATURE_NAME_LENGTH_MAX];
+        fmt_writer_t writer;
+        fmt_writer_init(&writer, topic, sizeof(topic));
+        fmt_write_string(&writer, TOPIC_HEALTH);
+        fmt_write_string(&writer, temperature_get_name(device));
+
+        static char string[160]; // all counters at their maximum, written by mqtt_task only
+        fmt_writer_init(&writer, string, sizeof(string));
+        fmt_write_string(&writer, "{\"reads\":");
+        fmt_write_int(&writer, health.read_count);
+        fmt_write_string(&writer, ",\"crc_errors\":");
+        fmt_write_int(&writer, health.crc_error_count);
+        fmt_write_string(&writer, ",\"timeouts\":");
+        fmt_write_int(&writer, health.timeout_count);
+        fmt_write_string(&writer, ",\"retries\":");
+        fmt_write_int(&writer, health.retry_count);
+        fmt_write_string(&writer, ",\"failures_in_row\":");
+        fmt_write_int(&writer, health.consecutive_failures);
+        fmt_write_string(&writer, ",\"state\":\"");
+        fmt_write_string(&writer, health_state_to_string(health.state));
+        fmt_write_string(&writer, "\"}");
+
+        esp_mqtt_client_publish(client, topic, string, writer.length, 0, MQTT_RETAIN_TRUE);
+    }
+}
+
+static void journal_temperature(const temperature_device_t *value)
+{
+    esp_err_t status = journal_append(value);
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to keep temperature of device %u: %s", value->device, esp_err_to_name(status));
+    }
+}
+
+// payload of one reading, written by mqtt_task only, the client copies it before publishing returns
+#if CONFIG_BROKER_PAYLOAD_PACKED
+static uint8_t reading_payload[PACKED_HEADER_SIZE + PACKED_RECORD_SIZE];
+#else
+static char reading_payload[JSON_PAYLOAD_SIZE]; // also for plain temperatures, replayed ones are JSON
+#endif
+
+#if CONFIG_BROKER_PUBLISH_BATCH
+#if CONFIG_BROKER_PAYLOAD_PACKED
+// header and a record per device
+#define BATCH_PAYLOAD_SIZE (PACKED_HEADER_SIZE + CONFIG_ONEWIRE_NUMBER_OF_DEVICES * PACKED_RECORD_SIZE)
+
+static size_t batch_to_packed(const temperature_device_t *values, size_t count, uint8_t *payload)
+{
+    size_t length = packed_write_header(payload, count);
+    for (size_t i = 0; i < count; ++i) {
+        temperature_info_t info;
+        bool is_info = temperature_get_info(values[i].device, &info) == ESP_OK;
+        length += packed_write_record(&payload[length], &values[i], is_info ? &info : NULL);
+    }
+    return length;
+}
+#else
+// {"device":127,"name":"...","temperature":-55.0,"uptime_us":...,"time_ms":...,"latency_ms":...}, per device
+#define BATCH_PAYLOAD_SIZE (32 + CONFIG_ONEWIRE_NUMBER_OF_DEVICES * (128 + TEMPERATURE_NAME_LENGTH_MAX))
+
+// return length, 0 if it does not fit
+static size_t batch_to_json(const temperature_device_t *values, size_t count, char *string, size_t size)
+{
+    fmt_writer_t writer;
+    fmt_writer_init(&writer, string, size);
+    fmt_write_string(&writer, "{\"readings\":[");
+    for (size_t i = 0; i < count; ++i) {
+        fmt_write_string(&writer, i == 0 ? "{\"device\":" : ",{\"device\":");
+        fmt_write_int(&writer, values[i].device);
+        fmt_write_string(&writer, ",\"name\":\"");
+        fmt_write_string(&writer, temperature_get_name(values[i].device));
+        fmt_write_string(&writer, "\",");
+        temperature_fields_to_json(&writer, &values[i]);
+        fmt_write_string(&writer, "}");
+    }
+    fmt_write_string(&writer, "]}");
+    return writer.is_overflow ? 0 : writer.length;
+}
+#endif
+
+// a sweep end lost with a full sample queue does not hold the batch longer than this
+#define BATCH_SWEEP_TIMEOUT_MS 5000
+
+// collect temperatures of a bus sweep, or of the batch window, starting with first, into one message
+static void publish_temperature(esp_mqtt_client_handle_t client, const temperature_device_t *first)
+{
+    static temperature_device_t values[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+    const TickType_t window = pdMS_TO_TICKS(CONFIG_BROKER_BATCH_WINDOW);
+    const TickType_t start = xTaskGetTickCount();
+
+    size_t count = 0;
+    values[count++] = *first;
+    temperature_device_t value;
+    while (count < CONFIG_ONEWIRE_NUMBER_OF_DEVICES) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (window != 0 && elapsed >= window) {
+            break;
+        }
+        if (!temperature_receive(&value, window != 0 ? window - elapsed : pdMS_TO_TICKS(BATCH_SWEEP_TIMEOUT_MS))) {
+            if (window == 0) {
+                break; // sweep ended
+            }
+            continue; // sweep ended before the window did
+        }
+
+        size_t i = 0;
+        while (i < count && values[i].device != value.device) {
+            ++i;
+        }
+        values[i] = value; // newest wins
+        if (i < count) {
+            break; // device came again, so the next sweep started
+        }
+        count++;
+    }
+
+#if CONFIG_BROKER_PAYLOAD_PACKED
+    static uint8_t payload[BATCH_PAYLOAD_SIZE];
+    size_t length = batch_to_packed(values, count, payload);
+#else
+    static char payload[BATCH_PAYLOAD_SIZE];
+    size_t length = batch_to_json(values, count, payload, sizeof(payload));
+#endif
+
+    // qos 1 messages wait in the client's outbox if the connection is lost meanwhile
+    if (!is_connected ||
+        esp_mqtt_client_publish(client, TOPIC_BATCH, (const char *)payload, length, 1, MQTT_RETAIN_FALSE) < 0) {
+        for (size_t i = 0; i < count; ++i) {
+            journal_temperature(&values[i]);
+        }
+    }
+}
+#else
+// topic of each device, written by mqtt_task only
+static char topics[CONFIG_ONEWIRE_NUMBER_OF_DEVICES][sizeof(TOPIC_TEMPERATURE) + TEMPERATURE_NAME_LENGTH_MAX];
+static uint8_t topic_num = 0;
+
+// build topics of devices added since the last call, names do not change until reboot
+static void add_topics(void)
 {
-    sprintf(string, "%.1f", number);  // Convert float to string with one decimal place
-    return string;
+    for (uint8_t device_num = temperature_get_device_num(); topic_num < device_num; ++topic_num) {
+        fmt_writer_t writer;
+        fmt_writer_init(&writer, topics[topic_num], sizeof(topics[topic_num]));
+        fmt_write_string(&writer, TOPIC_TEMPERATURE);
+        fmt_write_string(&writer, temperature_get_name(topic_num));
+    }
 }
 
-static const char* get_topic(char *topic, int device)
+static void publish_temperature(esp_mqtt_client_handle_t client, const temperature_device_t *value)
 {
-    sprintf(topic, "%s%d", TOPIC_TEMPERATURE, device);
-    return topic;
+#if CONFIG_BROKER_PAYLOAD_PLAIN
+    size_t length = fmt_temperature(reading_payload, value->temperature, 1);
+#elif CONFIG_BROKER_PAYLOAD_PACKED
+    size_t length = temperature_to_packed(value, reading_payload);
+#else
+    size_t length = temperature_to_json(value, reading_payload, sizeof(reading_payload));
+#endif
+
+    // qos 1 messages wait in the client's outbox if the connection is lost meanwhile
+    if (!is_connected || esp_mqtt_client_publish(client, topics[value->device], (const char *)reading_payload,
+                                                 length, 1, MQTT_RETAIN_TRUE) < 0) {
+        journal_temperature(value);
+    }
 }
+#endif
 
-static inline bool is_queue_created(QueueHandle_t queue)
+// commit the batch being replayed once it is acknowledged, then start the next one,
+// each on its own topic without retain, so replayed readings do not replace the latest retained ones
+static void replay_journal(esp_mqtt_client_handle_t client)
 {
-    return queue != NULL ? true : false;
+    static temperature_device_t values[CONFIG_JOURNAL_REPLAY_BATCH];
+
+    portENTER_CRITICAL(&replay_lock);
+    size_t size = replay_size;
+    size_t pending = replay_pending;
+    portEXIT_CRITICAL(&replay_lock);
+
+    if (size != 0) {
+        if (pending != 0) {
+            return; // wait for the broker
+        }
+        esp_err_t status = journal_commit_batch();
+        if (status != ESP_OK) {
+            ESP_LOGE(TAG, "Failed to commit replayed readings: %s", esp_err_to_name(status));
+            return;
+        }
+        portENTER_CRITICAL(&replay_lock);
+        replay_size = 0;
+        portEXIT_CRITICAL(&replay_lock);
+        return; // next batch after the replay interval
+    }
+
+    size_t count = journal_read_batch(values, CONFIG_JOURNAL_REPLAY_BATCH);
+    if (count == 0) {
+        if (journal_get_count() != 0) {
+            journal_commit_batch(); // only cut or already committed records, nothing to send
+        }
+        return;
+    }
+
+    portENTER_CRITICAL(&replay_lock);
+    replay_size = count;
+    replay_pending = count;
+    for (size_t i = 0; i < count; ++i) {
+        replay_msg_ids[i] = -1;
+    }
+    for (size_t i = 0; i < REPLAY_EARLY_IDS_SIZE; ++i) {
+        replay_early_ids[i] = -1;
+    }
+    portEXIT_CRITICAL(&replay_lock);
+
+    for (size_t i = 0; i < count; ++i) {
+        char topic[sizeof(TOPIC_JOURNAL) + TEMPERATURE_NAME_LENGTH_MAX];
+        fmt_writer_t writer;
+        fmt_writer_init(&writer, topic, sizeof(topic));
+        fmt_write_string(&writer, TOPIC_JOURNAL);
+        fmt_write_string(&writer, temperature_get_name(values[i].device)); // journal returns found devices only
+#if CONFIG_BROKER_PAYLOAD_PACKED
+        size_t length = temperature_to_packed(&values[i], reading_payload);
+#else
+        size_t length = temperature_to_json(&values[i], reading_payload, sizeof(reading_payload));
+#endif
+        int msg_id = esp_mqtt_client_publish(client, topic, (const char *)reading_payload, length, 1, MQTT_RETAIN_FALSE);
+
+        portENTER_CRITICAL(&replay_lock);
+        if (msg_id < 0) {
+            replay_size = 0; // try the whole batch again
+        } else if (replay_size != 0) {
+            replay_msg_ids[i] = msg_id;
+            for (size_t j = 0; j < REPLAY_EARLY_IDS_SIZE; ++j) {
+                if (replay_early_ids[j] == msg_id) {
+                    replay_early_ids[j] = -1;
+                    replay_msg_ids[i] = -1;
+                    replay_pending--;
+                    break;
+                }
+            }
+        }
+        size = replay_size;
+        portEXIT_CRITICAL(&replay_lock);
+
+        if (size == 0) {
+            return; // publish failed or disconnected, the batch is replayed again
+        }
+    }
 }
 
 static void mqtt_task(void *params)
 {
-    while (true) {
-        if (is_queue_created(temperature_queue)) {
-            temperature_device_t received_value;
-            BaseType_t status = xQueueReceive(temperature_queue, &received_value, portMAX_DELAY);
+    const esp_mqtt_client_handle_t client = *(esp_mqtt_client_handle_t*)params;
+    const TickType_t health_interval = pdMS_TO_TICKS(CONFIG_BROKER_HEALTH_PUBLISH_INTERVAL * 1000);
+    const TickType_t replay_interval = pdMS_TO_TICKS(CONFIG_JOURNAL_REPLAY_INTERVAL);
+    TickType_t last_health_time = xTaskGetTickCount();
 
-            if (status == pdPASS) {
-                char topic[sizeof(TOPIC_TEMPERATURE) + 3 * sizeof(char)];  // 3 chars for number 128 (max devices)
-                char string[20];  // 20 - maximum number of characters for a float: -[sign][d].[d...]e[sign]d
-                const esp_mqtt_client_handle_t client = *(esp_mqtt_client_handle_t*)params;
+    while (true) {
+        // wait for temperatures until health or the next replay batch is due
+        TickType_t elapsed = xTaskGetTickCount() - last_health_time;
+        TickType_t timeout = health_interval;
+        if (is_connected) {
+            if (elapsed >= health_interval) {
+                publish_health(client);
+                last_health_time = xTaskGetTickCount();
+                continue;
+            }
+            timeout = health_interval - elapsed;
 
-                esp_mqtt_client_publish(client, get_topic(topic, received_value.device),
-                                        float_to_string(received_value.temperature, string), 0, 1, MQTT_RETAIN_TRUE);
-            } else {
-                ESP_LOGE(TAG, "mqtt_task(): Failed to receive the message from the temperature_queue");
+            replay_journal(client);
+            if (journal_get_count() != 0 && timeout > replay_interval) {
+                timeout = replay_interval;
             }
-        } else {
-            ESP_LOGE(TAG, "The temperature_queue has not been created yet");
-            vTaskDelay(pdMS_TO_TICKS(1000));
+        }
+
+        temperature_device_t received_value;
+        if (temperature_receive(&received_value, timeout)) {
+#if !CONFIG_BROKER_PUBLISH_BATCH
+            add_topics(); // a device is added before its first reading is sent
+#endif
+            publish_temperature(client, &received_value);
         }
     }
 }
@@ -177,16 +846,21 @@ esp_err_t mqtt_init(void)
     static esp_mqtt_client_handle_t client;
     client = esp_mqtt_client_init(&mqtt_cfg);
 
+    esp_err_t status = journal_init();
+    if (status != ESP_OK) {
+        ESP_LOGW(TAG, "Journal is not available, readings are lost while disconnected: %s", esp_err_to_name(status));
+    }
+
     ESP_ERROR_CHECK(esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL));
     ESP_ERROR_CHECK(esp_mqtt_client_start(client));
 
-    BaseType_t status = xTaskCreate(mqtt_task, "mqtt_task", configMINIMAL_STACK_SIZE * 4, &client, PRIORITY_MIDDLE,
-                                    &mqtt_task_handle);
-    if (status != pdPASS) {
+    // task runs while disconnected too, to keep readings in the journal
+    BaseType_t task_status = xTaskCreate(mqtt_task, "mqtt_task", MQTT_TASK_STACK_SIZE, &client, PRIORITY_MIDDLE,
+                                         &mqtt_task_handle);
+    if (task_status != pdPASS) {
         ESP_LOGE(TAG, "mqtt_task(): Task was not created. Could not allocate required memory");
         return ESP_ERR_NO_MEM;
     }
-    vTaskSuspend(mqtt_task_handle);
 
     ESP_LOGI(TAG, "mqtt_init() finished successfully");
 
@@ -1,10 +1,13 @@
 #include "non_volatile_storage.h"
 
 #include "nvs_flash.h"
+#include "nvs.h"
 
 #include "esp_check.h"
 #include "esp_err.h"
 
+#define NVS_NAMESPACE "storage"
+
 esp_err_t nvs_init(void)
 {
     esp_err_t err = nvs_flash_init();
@@ -14,3 +17,32 @@ esp_err_t nvs_init(void)
     }
     return err;
 }
+
+esp_err_t nvs_read_blob(const char *key, void *value, size_t *length)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READONLY, &handle);
+    if (err != ESP_OK) {
+        return err;  // ESP_ERR_NVS_NOT_FOUND until the namespace is written for the first time
+    }
+
+    err = nvs_get_blob(handle, key, value, length);
+    nvs_close(handle);
+    return err;
+}
+
+esp_err_t nvs_write_blob(const char *key, const void *value, size_t length)
+{
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    err = nvs_set_blob(handle, key, value, length);
+    if (err == ESP_OK) {
+        err = nvs_commit(handle);
+    }
+    nvs_close(handle);
+    return err;
+}
@@ -0,0 +1,34 @@
+#include "packed.h"
+
+#include <string.h>
+
+// byte by byte, so the layout does not depend on the compiler's struct packing or the CPU's byte order
+static void packed_put_le(uint8_t *buffer, uint64_t value, size_t size)
+{
+    for (size_t i = 0; i < size; ++i) {
+        buffer[i] = (uint8_t)(value >> (8 * i));
+    }
+}
+
+size_t packed_write_header(uint8_t *buffer, uint8_t count)
+{
+    buffer[0] = PACKED_VERSION;
+    buffer[1] = count;
+    return PACKED_HEADER_SIZE;
+}
+
+size_t packed_write_record(uint8_t *buffer, const temperature_device_t *value, const temperature_info_t *info)
+{
+    if (info != NULL) {
+        memcpy(&buffer[0], info->rom_id, sizeof(info->rom_id));
+        buffer[9] = ((info->resolution >> 5) & 0x03) + 9; // R1 R0 of configuration register, 0 is 9-bit
+    } else {
+        memset(&buffer[0], 0, sizeof(info->rom_id));
+        buffer[9] = 0;
+    }
+    buffer[8] = value->device;
+    packed_put_le(&buffer[10], (uint16_t)value->temperature, 2);
+    packed_put_le(&buffer[12], (uint32_t)(value->timestamp_us / 1000), 4);
+    packed_put_le(&buffer[16], (uint64_t)value->unix_time_ms, 8);
+    return PACKED_RECORD_SIZE;
+}
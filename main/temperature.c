@@ -1,7 +1,10 @@
 #include "temperature.h"
 
-#include <math.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -10,172 +13,1347 @@
 #include "sdkconfig.h"
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "onewire_bus.h"
 #include "ds18b20.h"
+#include "filter.h"
+#include "fmt.h"
+#include "history.h"
+#include "non_volatile_storage.h"
+#include "time_sync.h"
 
 #include "types.h"
 
 static const char *TAG = "temperature";
 
 typedef struct {
-    uint8_t device_num;
+    uint8_t bus; /*!< index of the bus the device is connected to */
+    uint8_t rom_id[8];
+    char name[TEMPERATURE_NAME_LENGTH_MAX + 1]; /*!< set before the device is visible to other tasks, never changed */
+    bool is_present; /*!< found by the last rediscovery pass, retired devices keep their index until they come back */
+    uint32_t seen_pass; /*!< last rediscovery pass of the bus that found the device */
+    uint8_t missed_passes; /*!< complete rediscovery passes in a row that did not find the device */
+    ds18b20_resolution_t resolution;
+#if CONFIG_ONEWIRE_ALARM_MODE
+    int8_t alarm_high; /*!< TH, device is read after each conversion if temperature >= TH */
+    int8_t alarm_low; /*!< TL, device is read after each conversion if temperature <= TL */
+#endif
+    bool is_config_changed; /*!< configuration is not verified to be in the device's EEPROM yet */
+    filter_config_t filter_config; /*!< filter for readings of the device, applied by the processing task */
+    bool is_filter_changed; /*!< filter_config is not applied by the processing task yet */
+    temperature_deadband_t deadband;
+    bool is_deadband_changed; /*!< next reading is published regardless of deadband */
+    temperature_health_t health;
+    uint16_t backoff_sweeps; /*!< conversions to skip the device for, after failed reads */
+#if CONFIG_ONEWIRE_FAST_READ
+    bool is_fast_read_valid; /*!< last_raw_temperature is verified by CRC or plausibility, fast read can be trusted */
+    int16_t last_raw_temperature; /*!< last accepted temperature in 1/16 °C, fast reads are checked against it */
+    uint16_t fast_read_count; /*!< fast reads since the last full scratchpad read */
+#endif
+} ds18b20_device_t;
+
+typedef struct {
+    gpio_num_t gpio_pin;
     onewire_bus_handle_t handle;
-    uint8_t device_rom_id[CONFIG_ONEWIRE_NUMBER_OF_DEVICES][8];
-} ds18b20_task_params_t;
+    uint8_t device_num; /*!< number of devices connected to this bus, including retired ones */
+    onewire_rom_search_context_handler_t rediscovery; /*!< ROM search spread over sweeps, NULL between passes */
+    uint32_t rediscovery_pass; /*!< number of the running rediscovery pass */
+    size_t rediscovery_found_num; /*!< number of devices found by the running rediscovery pass */
+#if CONFIG_ONEWIRE_ALARM_MODE
+    uint32_t conversion_count;
+#endif
+    int64_t conversion_timestamp_us; /*!< esp_timer time the running conversion was triggered */
+    int64_t conversion_unix_time_ms; /*!< wall-clock time the running conversion was triggered, 0 if not synchronized */
+} ds18b20_bus_t;
+
+#if CONFIG_ONEWIRE_RESOLUTION_9B
+#define DEFAULT_RESOLUTION DS18B20_RESOLUTION_9B
+#elif CONFIG_ONEWIRE_RESOLUTION_10B
+#define DEFAULT_RESOLUTION DS18B20_RESOLUTION_10B
+#elif CONFIG_ONEWIRE_RESOLUTION_11B
+#define DEFAULT_RESOLUTION DS18B20_RESOLUTION_11B
+#else
+#define DEFAULT_RESOLUTION DS18B20_RESOLUTION_12B
+#endif
+
+static ds18b20_bus_t buses[CONFIG_ONEWIRE_NUMBER_OF_BUSES] = {
+    { .gpio_pin = CONFIG_ONEWIRE_DATA_GPIO_PIN },
+#if CONFIG_ONEWIRE_NUMBER_OF_BUSES > 1
+    { .gpio_pin = CONFIG_ONEWIRE_DATA_GPIO_PIN_1 },
+#endif
+#if CONFIG_ONEWIRE_NUMBER_OF_BUSES > 2
+    { .gpio_pin = CONFIG_ONEWIRE_DATA_GPIO_PIN_2 },
+#endif
+#if CONFIG_ONEWIRE_NUMBER_OF_BUSES > 3
+    { .gpio_pin = CONFIG_ONEWIRE_DATA_GPIO_PIN_3 },
+#endif
+};
+
+static const filter_config_t default_filter_config = {
+#if CONFIG_ONEWIRE_FILTER_MOVING_AVERAGE
+    .type = FILTER_TYPE_MOVING_AVERAGE,
+#elif CONFIG_ONEWIRE_FILTER_EMA
+    .type = FILTER_TYPE_EMA,
+#elif CONFIG_ONEWIRE_FILTER_MEDIAN
+    .type = FILTER_TYPE_MEDIAN,
+#elif CONFIG_ONEWIRE_FILTER_KALMAN
+    .type = FILTER_TYPE_KALMAN,
+#else
+    .type = FILTER_TYPE_NONE,
+#endif
+#if CONFIG_ONEWIRE_FILTER_MOVING_AVERAGE || CONFIG_ONEWIRE_FILTER_MEDIAN
+    .window = CONFIG_ONEWIRE_FILTER_WINDOW,
+#endif
+#if CONFIG_ONEWIRE_FILTER_EMA
+    .alpha = CONFIG_ONEWIRE_FILTER_EMA_ALPHA,
+#endif
+#if CONFIG_ONEWIRE_FILTER_KALMAN
+    .process_noise = CONFIG_ONEWIRE_FILTER_KALMAN_PROCESS_NOISE,
+    .measurement_noise = CONFIG_ONEWIRE_FILTER_KALMAN_MEASUREMENT_NOISE,
+#endif
+};
+
+static const temperature_deadband_t default_deadband = {
+    .absolute = CONFIG_ONEWIRE_DEADBAND * 16 / 100, // 1/100 °C to 1/16 °C, rounded down
+    .percent = CONFIG_ONEWIRE_DEADBAND_PERCENT,
+    .heartbeat_interval = CONFIG_ONEWIRE_HEARTBEAT_INTERVAL,
+};
+
+// Devices of all buses share one table, so the device index is global and does not depend on the bus
+static ds18b20_device_t devices[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+static uint8_t device_num = 0;
 
-QueueHandle_t temperature_queue = NULL;
+static QueueHandle_t sample_queue = NULL; // raw readings from the sampling task to the processing task
+#define SAMPLE_SWEEP_END UINT8_MAX // device of a sample queued after the readings of a bus sweep
 
-#define AVERAGE_ARRAY_SIZE 3
-static float get_average_temperature(size_t device, float temperature)
+// Last-value cache from the processing task to the publisher: a slot per device with its newest temperature
+// and a bit per device that is set when the slot changed. A slot is written under a sequence counter instead of
+// a lock, so neither side ever waits for the other and a slow publisher only skips older temperatures.
+typedef struct {
+    atomic_uint sequence; // odd while the slot is written, 0 if it never was
+    temperature_device_t value;
+} temperature_slot_t;
+
+#define TEMPERATURE_CHANGED_WORDS ((CONFIG_ONEWIRE_NUMBER_OF_DEVICES + 31) / 32)
+
+static temperature_slot_t temperature_slots[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+static atomic_uint temperature_changed[TEMPERATURE_CHANGED_WORDS];
+static TaskHandle_t temperature_consumer = NULL; // woken when a slot changed
+static atomic_bool is_sweep_ended = false; // a bus sweep was processed, set after its slots were written
+
+// only the processing task writes
+static void temperature_slot_write(const temperature_device_t *value)
 {
-    static float average_array[CONFIG_ONEWIRE_NUMBER_OF_DEVICES][AVERAGE_ARRAY_SIZE];
-    static bool is_average_array_init_with_nan = false;
+    temperature_slot_t *slot = &temperature_slots[value->device];
+    unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_relaxed);
 
-    if (!is_average_array_init_with_nan) {
-        for (size_t i = 0; i < CONFIG_ONEWIRE_NUMBER_OF_DEVICES; ++i) {
-            for (size_t k = 0; k < AVERAGE_ARRAY_SIZE; ++k) {
-                average_array[i][k] = NAN;
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot->value = *value;
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+
+    // marked after writing, so a slot skipped by the reader while it was written is taken again
+    atomic_fetch_or(&temperature_changed[value->device / 32], 1u << (value->device % 32));
+
+    TaskHandle_t consumer = temperature_consumer;
+    if (consumer != NULL) {
+        xTaskNotifyGive(consumer);
+    }
+}
+
+// return false if the slot is being written or was never written
+static bool temperature_slot_read(temperature_slot_t *slot, temperature_device_t *value)
+{
+    unsigned sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+    if (sequence == 0 || (sequence & 1) != 0) {
+        return false;
+    }
+    *value = slot->value;
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence;
+}
+
+// only the publisher takes, devices are scanned round-robin so a device changing often does not starve others
+static bool temperature_take_changed(temperature_device_t *value)
+{
+    static size_t next_device = 0;
+
+    for (size_t i = 0; i < CONFIG_ONEWIRE_NUMBER_OF_DEVICES; ++i) {
+        size_t device = (next_device + i) % CONFIG_ONEWIRE_NUMBER_OF_DEVICES;
+        unsigned bit = 1u << (device % 32);
+        if ((atomic_load(&temperature_changed[device / 32]) & bit) == 0) {
+            continue;
+        }
+
+        atomic_fetch_and(&temperature_changed[device / 32], ~bit);
+        if (temperature_slot_read(&temperature_slots[device], value)) {
+            next_device = device + 1;
+            return true;
+        }
+    }
+    return false;
+}
+static portMUX_TYPE devices_lock = portMUX_INITIALIZER_UNLOCKED; // sampling task adds devices, other tasks change thresholds
+
+// NVS key of the alias of a device, from its 48-bit serial number, as keys are at most 15 characters
+static void ds18b20_get_alias_key(const uint8_t *rom_id, char *key, size_t size)
+{
+    snprintf(key, size, "alias%02X%02X%02X%02X%02X%02X", rom_id[1], rom_id[2], rom_id[3], rom_id[4], rom_id[5], rom_id[6]);
+}
+
+// read alias of a device from NVS, return false if it has none
+static bool ds18b20_read_alias(const uint8_t *rom_id, char *name)
+{
+    char key[16];
+    size_t length = TEMPERATURE_NAME_LENGTH_MAX;
+    ds18b20_get_alias_key(rom_id, key, sizeof(key));
+    if (nvs_read_blob(key, name, &length) != ESP_OK || length == 0) {
+        return false;
+    }
+    name[length] = '\0';
+    return true;
+}
+
+// name of a device without alias
+static void ds18b20_get_default_name(size_t device, const uint8_t *rom_id, char *name, size_t size)
+{
+#if CONFIG_BROKER_TOPIC_KEY_INDEX
+    snprintf(name, size, "device_%u", (unsigned)device);
+#else
+    snprintf(name, size, ONEWIRE_ROM_ID_STR, ONEWIRE_ROM_ID(rom_id));
+#endif
+}
+
+static bool ds18b20_is_resolution(ds18b20_resolution_t resolution)
+{
+    return resolution == DS18B20_RESOLUTION_9B || resolution == DS18B20_RESOLUTION_10B ||
+           resolution == DS18B20_RESOLUTION_11B || resolution == DS18B20_RESOLUTION_12B;
+}
+
+// NVS key of the resolution of a device set at runtime, from its 48-bit serial number
+static void ds18b20_get_resolution_key(const uint8_t *rom_id, char *key, size_t size)
+{
+    snprintf(key, size, "res%02X%02X%02X%02X%02X%02X", rom_id[1], rom_id[2], rom_id[3], rom_id[4], rom_id[5], rom_id[6]);
+}
+
+// read resolution of a device from NVS, return the one of menuconfig if it has none
+static ds18b20_resolution_t ds18b20_read_resolution(const uint8_t *rom_id)
+{
+    char key[16];
+    uint8_t resolution;
+    size_t length = sizeof(resolution);
+    ds18b20_get_resolution_key(rom_id, key, sizeof(key));
+    if (nvs_read_blob(key, &resolution, &length) != ESP_OK || length != sizeof(resolution) ||
+        !ds18b20_is_resolution(resolution)) {
+        return DEFAULT_RESOLUTION;
+    }
+    return resolution;
+}
+
+#if CONFIG_ONEWIRE_ALARM_MODE
+// NVS key of the alarm thresholds of a device set at runtime, from its 48-bit serial number
+static void ds18b20_get_alarm_key(const uint8_t *rom_id, char *key, size_t size)
+{
+    snprintf(key, size, "alm%02X%02X%02X%02X%02X%02X", rom_id[1], rom_id[2], rom_id[3], rom_id[4], rom_id[5], rom_id[6]);
+}
+
+// read alarm thresholds of a device from NVS, high first, return the ones of menuconfig if it has none
+static void ds18b20_read_alarm_thresholds(const uint8_t *rom_id, int8_t *thresholds)
+{
+    char key[16];
+    size_t length = 2;
+    ds18b20_get_alarm_key(rom_id, key, sizeof(key));
+    if (nvs_read_blob(key, thresholds, &length) != ESP_OK || length != 2 || thresholds[1] > thresholds[0]) {
+        thresholds[0] = CONFIG_ONEWIRE_ALARM_HIGH_TEMPERATURE;
+        thresholds[1] = CONFIG_ONEWIRE_ALARM_LOW_TEMPERATURE;
+    }
+}
+#endif
+
+// add device to the table unless it is known already, return false if the table is full
+static bool ds18b20_add_device(uint8_t bus_index, const uint8_t *rom_id, bool *is_added)
+{
+    bool is_added_to_table = false;
+    bool is_full = false;
+
+    char name[TEMPERATURE_NAME_LENGTH_MAX + 1]; // settings of the device are read before the lock as they read NVS
+    bool is_alias = ds18b20_read_alias(rom_id, name);
+    ds18b20_resolution_t resolution = ds18b20_read_resolution(rom_id);
+#if CONFIG_ONEWIRE_ALARM_MODE
+    int8_t alarm_thresholds[2];
+    ds18b20_read_alarm_thresholds(rom_id, alarm_thresholds);
+#endif
+
+    portENTER_CRITICAL(&devices_lock);
+    size_t device = 0;
+    while (device < device_num && (devices[device].bus != bus_index || memcmp(devices[device].rom_id, rom_id, 8) != 0)) {
+        ++device;
+    }
+    if (device == device_num) {
+        if (device_num < CONFIG_ONEWIRE_NUMBER_OF_DEVICES) {
+            devices[device].bus = bus_index;
+            memcpy(devices[device].rom_id, rom_id, 8);
+            if (!is_alias) {
+                ds18b20_get_default_name(device, rom_id, name, sizeof(name));
             }
+            memcpy(devices[device].name, name, sizeof(name));
+            devices[device].is_present = true;
+            devices[device].seen_pass = buses[bus_index].rediscovery_pass;
+            devices[device].resolution = resolution;
+#if CONFIG_ONEWIRE_ALARM_MODE
+            devices[device].alarm_high = alarm_thresholds[0];
+            devices[device].alarm_low = alarm_thresholds[1];
+#endif
+            devices[device].is_config_changed = true;
+            devices[device].filter_config = default_filter_config;
+            devices[device].is_filter_changed = true;
+            devices[device].deadband = default_deadband;
+            devices[device].is_deadband_changed = true;
+            device_num++;  // entry is complete before other tasks can see it
+            buses[bus_index].device_num++;
+            is_added_to_table = true;
+        } else {
+            is_full = true;
+        }
+    }
+    portEXIT_CRITICAL(&devices_lock);
+
+    if (is_added_to_table) {
+        ESP_LOGI(TAG, "found device %d with rom id " ONEWIRE_ROM_ID_STR " on bus %d, named %s", device,
+                 ONEWIRE_ROM_ID(rom_id), bus_index, name);
+        if (history_add_device(device) != ESP_OK) {
+            ESP_LOGW(TAG, "History of device %d is not kept", device);
+        }
+    }
+    *is_added = is_added_to_table;
+    return !is_full;
+}
+
+// search the bus and add devices not in the table yet, return number of added devices
+static size_t ds18b20_search_devices(uint8_t bus_index)
+{
+    size_t added_num = 0;
+
+    // create 1-wire rom search context
+    onewire_rom_search_context_handler_t context_handler;
+    ESP_ERROR_CHECK(onewire_rom_search_context_create(buses[bus_index].handle, &context_handler));
+
+    // search for devices on the bus
+    while (true) {
+        esp_err_t search_result = onewire_rom_search(context_handler);
+
+        if (search_result == ESP_ERR_INVALID_CRC) {
+            continue; // continue on crc error
+        } else if (search_result == ESP_FAIL || search_result == ESP_ERR_NOT_FOUND) {
+            break; // break on finish or no device
+        }
+
+        uint8_t rom_id[8];
+        bool is_added;
+        ESP_ERROR_CHECK(onewire_rom_get_number(context_handler, rom_id));
+        if (!ds18b20_add_device(bus_index, rom_id, &is_added)) {
+            ESP_LOGW(TAG, "device table is full, increase number of DS18B20 devices");
+            break;
         }
-        is_average_array_init_with_nan = true;
+        added_num += is_added;
     }
 
-    static size_t index[CONFIG_ONEWIRE_NUMBER_OF_DEVICES] = {0};
-    average_array[device][index[device]] = temperature;
-    index[device] = (index[device] + 1) % AVERAGE_ARRAY_SIZE;
+    // delete 1-wire rom search context
+    ESP_ERROR_CHECK(onewire_rom_search_context_delete(context_handler));
+    return added_num;
+}
 
-    size_t count = 0;
-    float average = 0.0;
-    for (size_t i = 0; i < AVERAGE_ARRAY_SIZE; ++i) {
-        if (!isnan(average_array[device][i])) {
-            average += average_array[device][i];
-            count++;
+// store rom ids of the devices on the bus, so the next boot does not need to search
+static void ds18b20_save_devices(uint8_t bus_index)
+{
+    uint8_t (*rom_ids)[8] = malloc(CONFIG_ONEWIRE_NUMBER_OF_DEVICES * sizeof(*rom_ids));
+    if (rom_ids == NULL) {
+        ESP_LOGW(TAG, "ds18b20_save_devices(): Could not allocate required memory");
+        return;
+    }
+
+    size_t rom_num = 0;
+    for (size_t device = 0; device < device_num; ++device) {
+        if (devices[device].bus == bus_index) {
+            memcpy(rom_ids[rom_num++], devices[device].rom_id, sizeof(*rom_ids));
         }
     }
-    return count > 0 ? average / (float)count : NAN;
+
+    char key[16]; // NVS keys are at most 15 characters
+    snprintf(key, sizeof(key), "ds18b20_bus%d", bus_index);
+    esp_err_t err = nvs_write_blob(key, rom_ids, rom_num * sizeof(*rom_ids));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to store devices of bus %d: %s", bus_index, esp_err_to_name(err));
+    }
+    free(rom_ids);
 }
 
-#define CHANGE_THRESHOLD 0.09  // °C
-static bool is_temperature_changed(size_t device, float current_temperature)
+// add devices stored in NVS if every one of them answers when addressed, return false if a search is needed
+static bool ds18b20_restore_devices(uint8_t bus_index)
 {
-    static float previous_temperature[CONFIG_ONEWIRE_NUMBER_OF_DEVICES] = {0.0};
+    uint8_t (*rom_ids)[8] = malloc(CONFIG_ONEWIRE_NUMBER_OF_DEVICES * sizeof(*rom_ids));
+    if (rom_ids == NULL) {
+        return false;
+    }
+
+    char key[16]; // NVS keys are at most 15 characters
+    snprintf(key, sizeof(key), "ds18b20_bus%d", bus_index);
+    size_t length = CONFIG_ONEWIRE_NUMBER_OF_DEVICES * sizeof(*rom_ids);
+    bool is_restored = nvs_read_blob(key, rom_ids, &length) == ESP_OK && length > 0 && length % sizeof(*rom_ids) == 0;
+    size_t rom_num = is_restored ? length / sizeof(*rom_ids) : 0;
 
-    bool is_changed = fabs(current_temperature - previous_temperature[device]) > (float)CHANGE_THRESHOLD;
-    if (is_changed) {
-        previous_temperature[device] = current_temperature;
+    // a scratchpad with valid CRC proves the addressed device is on the bus, retry once on noise
+    for (size_t i = 0; i < rom_num && is_restored; ++i) {
+        ds18b20_scratchpad_t scratchpad;
+        if (ds18b20_read_scratchpad(buses[bus_index].handle, rom_ids[i], &scratchpad) != ESP_OK &&
+                ds18b20_read_scratchpad(buses[bus_index].handle, rom_ids[i], &scratchpad) != ESP_OK) {
+            ESP_LOGI(TAG, "stored device " ONEWIRE_ROM_ID_STR " is missing on bus %d", ONEWIRE_ROM_ID(rom_ids[i]), bus_index);
+            is_restored = false;
+        }
+    }
+
+    for (size_t i = 0; i < rom_num && is_restored; ++i) {
+        bool is_added;
+        is_restored = ds18b20_add_device(bus_index, rom_ids[i], &is_added);
     }
-    return is_changed;
+
+    free(rom_ids);
+    return is_restored;
 }
 
-static void ds18b20_task(void *params)
+static void ds18b20_send_sample(size_t device, int16_t temperature)
 {
-    // convert and read temperature
-    while (true) {
-        esp_err_t err;
-        ds18b20_task_params_t task_params = *(ds18b20_task_params_t*)params;
+    const ds18b20_bus_t *bus = &buses[devices[device].bus];
+    temperature_device_t sample = {
+        .device = device,
+        .temperature = temperature,
+        .timestamp_us = bus->conversion_timestamp_us, // reading is the temperature when conversion started
+        .unix_time_ms = bus->conversion_unix_time_ms,
+    };
+    if (LOG_LOCAL_LEVEL >= ESP_LOG_DEBUG) { // a line per reading, formatted only if debug logs are built in
+        char string[FMT_TEMPERATURE_LENGTH_MAX];
+        fmt_temperature(string, sample.temperature, FMT_TEMPERATURE_DECIMALS_MAX);
+        ESP_LOGD(TAG, "Temperature of device " ONEWIRE_ROM_ID_STR ": %s°C", ONEWIRE_ROM_ID(devices[device].rom_id), string);
+    }
 
-        vTaskDelay(pdMS_TO_TICKS(200));
+    // averaging and publishing is left to the processing task, so the bus is free for the next conversion
+    BaseType_t status = xQueueSend(sample_queue, &sample, 0);
+    if (status != pdPASS) {
+        ESP_LOGW(TAG, "ds18b20_task(): Failed to send the sample");
+    }
+}
 
-        // set all sensors' temperature conversion resolution
-        err = ds18b20_set_resolution(task_params.handle, NULL, DS18B20_RESOLUTION_12B);
-        if (err != ESP_OK) {
+// tell the processing task all readings of the conversion are queued, it passes it on when they are processed
+static void ds18b20_send_sweep_end(void)
+{
+    const temperature_device_t sample = { .device = SAMPLE_SWEEP_END };
+    if (xQueueSend(sample_queue, &sample, 0) != pdPASS) {
+        ESP_LOGW(TAG, "ds18b20_task(): Failed to send the end of sweep");
+    }
+}
+
+// a read per device, owned by the sampling task except while the bus worker task runs it
+typedef struct {
+    ds18b20_read_request_t read;
+    uint8_t retries; /*!< immediate retries after CRC error */
+    esp_err_t result; /*!< transaction result, set by the bus worker task */
+} ds18b20_pending_read_t;
+
+static ds18b20_pending_read_t pending_reads[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+static QueueHandle_t read_done_queue; // completed pending_reads, from the bus worker tasks to the sampling task
+
+// runs in the bus worker task, hands the completed read back to the sampling task
+static void ds18b20_read_done(onewire_bus_handle_t handle, onewire_bus_request_t *request, esp_err_t result)
+{
+    ds18b20_pending_read_t *pending = request->user_ctx;
+    pending->result = result;
+    xQueueSend(read_done_queue, &pending, 0); // a device has one read at a time, the queue holds all of them
+}
+
+// submit a read of the device, only its temperature bytes while fast reads can be trusted
+static esp_err_t ds18b20_submit_device_read(size_t device)
+{
+    ds18b20_device_t *dev = &devices[device];
+    ds18b20_pending_read_t *pending = &pending_reads[device];
+    bool is_fast = false;
+#if CONFIG_ONEWIRE_FAST_READ
+    is_fast = dev->is_fast_read_valid && dev->fast_read_count < CONFIG_ONEWIRE_FAST_READ_FULL_INTERVAL;
+#endif
+
+    pending->read.request.on_done = ds18b20_read_done;
+    pending->read.request.user_ctx = pending;
+    return ds18b20_submit_read(buses[dev->bus].handle, dev->rom_id, is_fast, &pending->read);
+}
+
+#if CONFIG_ONEWIRE_FAST_READ
+#define FAST_READ_MIN_RAW_TEMPERATURE (-55 * 16) // DS18B20 measuring range
+#define FAST_READ_MAX_RAW_TEMPERATURE (125 * 16)
+#define FAST_READ_POWER_ON_RAW_TEMPERATURE 0x0550 // 85 °C, cannot be told from a real reading without byte 6
+
+// send a fast reading, return false if it is doubtful and a full scratchpad read is due
+static bool ds18b20_accept_fast_read(size_t device, esp_err_t err, int16_t raw_temperature)
+{
+    ds18b20_device_t *dev = &devices[device];
+    if (err != ESP_OK) {
+        return false; // including all bits read as 1, a device gone since the last read
+    }
+
+    // without CRC a bit error or a device gone since the last read are only caught by plausibility
+    if (raw_temperature < FAST_READ_MIN_RAW_TEMPERATURE || raw_temperature > FAST_READ_MAX_RAW_TEMPERATURE ||
+        raw_temperature == FAST_READ_POWER_ON_RAW_TEMPERATURE ||
+        abs(raw_temperature - dev->last_raw_temperature) > CONFIG_ONEWIRE_FAST_READ_MAX_STEP * 16) {
+        ESP_LOGD(TAG, "Doubtful fast read of device " ONEWIRE_ROM_ID_STR ", reading full scratchpad", ONEWIRE_ROM_ID(dev->rom_id));
+        return false;
+    }
+
+    dev->last_raw_temperature = raw_temperature;
+    dev->fast_read_count++;
+    ds18b20_send_sample(device, raw_temperature);
+    return true;
+}
+#endif
+
+// send the reading of a CRC checked scratchpad, the power-on value of a device reset since the conversion is discarded
+static void ds18b20_accept_full_read(size_t device, int16_t raw_temperature)
+{
+    const ds18b20_scratchpad_t *scratchpad = &pending_reads[device].read.scratchpad;
+
+    // a device reset since the conversion did not convert, and may have recalled another configuration from EEPROM
+    bool is_reset = ds18b20_is_power_on_value(scratchpad);
+    if (is_reset || scratchpad->configuration != devices[device].resolution) {
+        portENTER_CRITICAL(&devices_lock);
+        devices[device].is_config_changed = true;
+        portEXIT_CRITICAL(&devices_lock);
+    }
+    if (is_reset) {
+        ESP_LOGW(TAG, "Device " ONEWIRE_ROM_ID_STR " was reset, power-on value discarded", ONEWIRE_ROM_ID(devices[device].rom_id));
+        return; // device answered, it is healthy
+    }
+
+#if CONFIG_ONEWIRE_FAST_READ
+    // CRC checked reading is the reference for the next fast reads
+    devices[device].last_raw_temperature = raw_temperature;
+    devices[device].fast_read_count = 0;
+    devices[device].is_fast_read_valid = true;
+#endif
+
+    ds18b20_send_sample(device, raw_temperature);
+}
+
+// keep health of the device up to date after its read is done
+static void ds18b20_update_health(size_t device, esp_err_t err, uint8_t retries)
+{
+    ds18b20_device_t *dev = &devices[device];
+
+    portENTER_CRITICAL(&devices_lock);
+    temperature_health_t *health = &dev->health;
+    temperature_health_state_t previous_state = health->state;
+    health->retry_count += retries;
+    if (err == ESP_OK) {
+        health->read_count++;
+        health->consecutive_failures = 0;
+        health->state = TEMPERATURE_HEALTH_OK;
+    } else {
+        if (err == ESP_ERR_INVALID_CRC) {
+            health->crc_error_count++;
+        } else {
+            health->timeout_count++;
+        }
+        if (health->consecutive_failures < UINT8_MAX) {
+            health->consecutive_failures++;
+        }
+        if (health->consecutive_failures >= CONFIG_ONEWIRE_QUARANTINE_THRESHOLD) {
+            health->state = TEMPERATURE_HEALTH_QUARANTINED;
+            dev->backoff_sweeps = CONFIG_ONEWIRE_QUARANTINE_POLL_INTERVAL - 1;
+        } else {
+            health->state = TEMPERATURE_HEALTH_BACKOFF;
+            dev->backoff_sweeps = (1 << (health->consecutive_failures - 1)) - 1; // 0, 1, 3, 7, ...
+        }
+    }
+    temperature_health_state_t state = health->state;
+    portEXIT_CRITICAL(&devices_lock);
+
+    if (state == TEMPERATURE_HEALTH_QUARANTINED && previous_state != TEMPERATURE_HEALTH_QUARANTINED) {
+        ESP_LOGW(TAG, "device %d with rom id " ONEWIRE_ROM_ID_STR " is quarantined after %d failed reads: %s",
+                 device, ONEWIRE_ROM_ID(dev->rom_id), CONFIG_ONEWIRE_QUARANTINE_THRESHOLD, esp_err_to_name(err));
+    } else if (state == TEMPERATURE_HEALTH_OK && previous_state == TEMPERATURE_HEALTH_QUARANTINED) {
+        ESP_LOGI(TAG, "device %d with rom id " ONEWIRE_ROM_ID_STR " recovered from quarantine", device, ONEWIRE_ROM_ID(dev->rom_id));
+    }
+}
+
+// submit a read of the device unless it is backing off after failed reads, return true if it was submitted
+static bool ds18b20_submit_device_read_checked(size_t device)
+{
+    ds18b20_device_t *dev = &devices[device];
+    if (dev->backoff_sweeps > 0) {
+        dev->backoff_sweeps--;
+        return false;
+    }
+
+    pending_reads[device].retries = 0;
+    esp_err_t err = ds18b20_submit_device_read(device);
+    if (err != ESP_OK) {
+        ds18b20_update_health(device, err, 0);
+        return false;
+    }
+    return true;
+}
+
+// handle a completed read and send its sample, return true if the device is read again, a doubtful fast read
+// is followed by a full read, and a read with CRC error is retried right away
+static bool ds18b20_complete_device_read(size_t device)
+{
+    ds18b20_pending_read_t *pending = &pending_reads[device];
+    int16_t raw_temperature = 0;
+    esp_err_t err = ds18b20_get_read_temperature(&pending->read, pending->result, devices[device].resolution,
+                                                 &raw_temperature);
+
+#if CONFIG_ONEWIRE_FAST_READ
+    if (pending->read.is_fast) {
+        if (ds18b20_accept_fast_read(device, err, raw_temperature)) {
+            ds18b20_update_health(device, ESP_OK, 0);
+            return false;
+        }
+        devices[device].is_fast_read_valid = false; // until the full read succeeds
+        err = ds18b20_submit_device_read(device);
+        if (err == ESP_OK) {
+            return true;
+        }
+        ds18b20_update_health(device, err, 0);
+        return false;
+    }
+#endif
+
+    // a device without answer is not retried, it would only cost more bus time
+    if (err == ESP_ERR_INVALID_CRC && pending->retries < CONFIG_ONEWIRE_READ_RETRIES) {
+        pending->retries++;
+        if (ds18b20_submit_device_read(device) == ESP_OK) {
+            return true;
+        }
+    }
+
+    if (err == ESP_OK) {
+        ds18b20_accept_full_read(device, raw_temperature);
+    }
+    ds18b20_update_health(device, err, pending->retries);
+    return false;
+}
+
+// wait until the submitted reads and the reads they were followed by are done
+static void ds18b20_wait_for_reads(size_t read_num)
+{
+    while (read_num > 0) {
+        ds18b20_pending_read_t *pending;
+        if (xQueueReceive(read_done_queue, &pending, portMAX_DELAY) != pdPASS) {
+            continue; // every submitted read completes, the bus limits its time by its length
+        }
+        if (!ds18b20_complete_device_read(pending - pending_reads)) {
+            read_num--;
+        }
+    }
+}
+
+uint8_t temperature_get_device_num(void)
+{
+    return device_num;
+}
+
+const char *temperature_get_name(uint8_t device)
+{
+    if (device >= device_num) {
+        return NULL;
+    }
+    return devices[device].name; // never changed after the device is added
+}
+
+esp_err_t temperature_set_alias(uint8_t device, const char *alias)
+{
+    if (device >= device_num || alias == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t length = strlen(alias);
+    if (length > TEMPERATURE_NAME_LENGTH_MAX || strpbrk(alias, "/+#") != NULL) {
+        return ESP_ERR_INVALID_ARG; // would not be a single topic level
+    }
+
+    // names from the next boot must stay unique, ROM IDs of added devices never change
+    char default_name[TEMPERATURE_NAME_LENGTH_MAX + 1];
+    ds18b20_get_default_name(device, devices[device].rom_id, default_name, sizeof(default_name));
+    const char *name = length != 0 ? alias : default_name;
+    for (uint8_t other = 0; other < device_num; ++other) {
+        char other_name[TEMPERATURE_NAME_LENGTH_MAX + 1];
+        if (other == device) {
             continue;
         }
+        if (!ds18b20_read_alias(devices[other].rom_id, other_name)) {
+            ds18b20_get_default_name(other, devices[other].rom_id, other_name, sizeof(other_name));
+        }
+        if (strcmp(other_name, name) == 0) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    char key[16];
+    ds18b20_get_alias_key(devices[device].rom_id, key, sizeof(key));
+    return nvs_write_blob(key, alias, length);
+}
+
+esp_err_t temperature_get_info(uint8_t device, temperature_info_t *info)
+{
+    if (device >= device_num || info == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&devices_lock);
+    memcpy(info->rom_id, devices[device].rom_id, sizeof(info->rom_id));
+    info->resolution = devices[device].resolution;
+    portEXIT_CRITICAL(&devices_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t temperature_find_device(const uint8_t *rom_id, uint8_t *device)
+{
+    if (rom_id == NULL || device == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (uint8_t i = 0; i < device_num; ++i) {
+        if (memcmp(devices[i].rom_id, rom_id, sizeof(devices[i].rom_id)) == 0) { // never changed after it is added
+            *device = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t temperature_find_device_by_name(const char *name, size_t length, uint8_t *device)
+{
+    if (name == NULL || device == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    for (uint8_t i = 0; i < device_num && length <= TEMPERATURE_NAME_LENGTH_MAX; ++i) {
+        if (strlen(devices[i].name) == length && memcmp(devices[i].name, name, length) == 0) { // never changed after it is added
+            *device = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t temperature_get_health(uint8_t device, temperature_health_t *health)
+{
+    if (device >= device_num || health == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-        // trigger all sensors to start temperature conversion
-        err = ds18b20_trigger_temperature_conversion(task_params.handle, NULL); // skip rom to send command to all devices on the bus
-        if (err != ESP_OK) {
+    portENTER_CRITICAL(&devices_lock);
+    *health = devices[device].health;
+    portEXIT_CRITICAL(&devices_lock);
+
+    return ESP_OK;
+}
+
+// submit reads of the present devices of a bus, return the number submitted
+static size_t ds18b20_submit_bus_reads(uint8_t bus_index)
+{
+    size_t read_num = 0;
+    for (size_t device = 0; device < device_num; ++device) {
+        if (devices[device].bus == bus_index && devices[device].is_present &&
+                ds18b20_submit_device_read_checked(device)) {
+            read_num++;
+        }
+    }
+    return read_num;
+}
+
+// configure devices whose configuration changed or may have been lost, devices already configured are only read
+static void ds18b20_configure_devices(uint8_t bus_index)
+{
+    for (size_t device = 0; device < device_num; ++device) {
+        if (devices[device].bus != bus_index || !devices[device].is_present) {
             continue;
         }
 
-        vTaskDelay(pdMS_TO_TICKS(800)); // 12-bit resolution needs 750ms to convert
+        portENTER_CRITICAL(&devices_lock);
+        bool is_config_changed = devices[device].is_config_changed;
+        ds18b20_resolution_t resolution = devices[device].resolution;
+#if CONFIG_ONEWIRE_ALARM_MODE
+        int8_t alarm_high = devices[device].alarm_high;
+        int8_t alarm_low = devices[device].alarm_low;
+#else
+        int8_t alarm_high = DS18B20_ALARM_TH_DISABLED;
+        int8_t alarm_low = DS18B20_ALARM_TL_DISABLED;
+#endif
+        devices[device].is_config_changed = false;
+        portEXIT_CRITICAL(&devices_lock);
 
-        // get temperature from sensors
-        for (size_t device = 0; device < task_params.device_num; ++device) {
-            float temperature;
-            err = ds18b20_get_temperature(task_params.handle, task_params.device_rom_id[device], &temperature); // read scratchpad and get temperature
-            if (err != ESP_OK) {
-                continue;
-            }
-            ESP_LOGI(TAG, "Temperature of device " ONEWIRE_ROM_ID_STR ": %.2f°C",
-                     ONEWIRE_ROM_ID(task_params.device_rom_id[device]), temperature);
+#if CONFIG_ONEWIRE_FAST_READ
+        if (is_config_changed) {
+            devices[device].is_fast_read_valid = false; // resolution, or the device itself may have changed
+        }
+#endif
+
+        if (is_config_changed && ds18b20_configure(buses[bus_index].handle, devices[device].rom_id, alarm_high,
+                                                   alarm_low, resolution) != ESP_OK) {
+            portENTER_CRITICAL(&devices_lock);
+            devices[device].is_config_changed = true; // retry on the next conversion
+            portEXIT_CRITICAL(&devices_lock);
+        }
+    }
+}
 
-            temperature = get_average_temperature(device, temperature);
+esp_err_t temperature_set_resolution(uint8_t device, ds18b20_resolution_t resolution)
+{
+    if (device >= device_num || !ds18b20_is_resolution(resolution)) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-            if (is_temperature_changed(device, temperature)) {
-                temperature_device_t temperature_device_to_send = {
-                    .device = device,
-                    .temperature = temperature,
-                };
+    portENTER_CRITICAL(&devices_lock);
+    devices[device].resolution = resolution;
+    devices[device].is_config_changed = true; // written before the next conversion
+    portEXIT_CRITICAL(&devices_lock);
 
-                BaseType_t status = xQueueSend(temperature_queue, &temperature_device_to_send, 0);
-                if (status != pdPASS) {
-                    ESP_LOGW(TAG, "ds18b20_task(): Failed to send the message");
-                }
-            }
+    // the device keeps it in EEPROM, but is configured with the one of menuconfig after a reboot otherwise
+    char key[16];
+    uint8_t value = resolution;
+    ds18b20_get_resolution_key(devices[device].rom_id, key, sizeof(key));
+    return nvs_write_blob(key, &value, sizeof(value));
+}
+
+bool temperature_receive(temperature_device_t *value, TickType_t timeout)
+{
+    temperature_consumer = xTaskGetCurrentTaskHandle();
+
+    const TickType_t start = xTaskGetTickCount();
+    while (!temperature_take_changed(value)) {
+        if (atomic_exchange(&is_sweep_ended, false)) {
+            return false; // all temperatures of the sweep are taken
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if (elapsed >= timeout || ulTaskNotifyTake(pdTRUE, timeout - elapsed) == 0) {
+            return false;
         }
-        vTaskDelay(pdMS_TO_TICKS(CONFIG_ONEWIRE_TEMPERATURE_UPDATE_TIME * 1000));
     }
+    return true;
 }
 
-esp_err_t ds18b20_init(void)
+void temperature_mark_all_changed(void)
 {
-    onewire_rmt_config_t config = {
-        .gpio_pin = CONFIG_ONEWIRE_DATA_GPIO_PIN,
-        .max_rx_bytes = 10, // 10 tx bytes (1byte ROM command + 8byte ROM number + 1byte device command)
-    };
+    for (size_t device = 0; device < CONFIG_ONEWIRE_NUMBER_OF_DEVICES; ++device) {
+        if (atomic_load(&temperature_slots[device].sequence) != 0) {
+            atomic_fetch_or(&temperature_changed[device / 32], 1u << (device % 32));
+        }
+    }
 
-    // install new 1-wire bus
+    TaskHandle_t consumer = temperature_consumer;
+    if (consumer != NULL) {
+        xTaskNotifyGive(consumer);
+    }
+}
 
-    // NOTE: The parameter "task_params" must still exist when the created task executes. It must be static.
-    static ds18b20_task_params_t task_params = {
-        .device_num = 0,
-    };
+esp_err_t temperature_set_deadband(uint8_t device, const temperature_deadband_t *deadband)
+{
+    if (device >= device_num || deadband == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
 
-    ESP_ERROR_CHECK(onewire_new_bus_rmt(&config, &task_params.handle));
-    ESP_LOGI(TAG, "1-wire bus installed");
+    portENTER_CRITICAL(&devices_lock);
+    devices[device].deadband = *deadband;
+    devices[device].is_deadband_changed = true;
+    portEXIT_CRITICAL(&devices_lock);
 
-    // create 1-wire rom search context
+    return ESP_OK;
+}
+
+esp_err_t temperature_get_deadband(uint8_t device, temperature_deadband_t *deadband)
+{
+    if (device >= device_num || deadband == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&devices_lock);
+    *deadband = devices[device].deadband;
+    portEXIT_CRITICAL(&devices_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t temperature_set_filter(uint8_t device, const filter_config_t *config)
+{
+    filter_t filter;
+    if (device >= device_num || filter_init(&filter, config) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&devices_lock);
+    devices[device].filter_config = *config;
+    devices[device].is_filter_changed = true; // filter starts over with the next reading
+    portEXIT_CRITICAL(&devices_lock);
+
+    return ESP_OK;
+}
+
+#if CONFIG_ONEWIRE_ALARM_MODE
+// find devices out of their thresholds with alarm search and submit reads of only those, return the number submitted
+static size_t ds18b20_submit_alarm_reads(uint8_t bus_index)
+{
     onewire_rom_search_context_handler_t context_handler;
-    ESP_ERROR_CHECK(onewire_rom_search_context_create(task_params.handle, &context_handler));
+    if (onewire_rom_search_context_create(buses[bus_index].handle, &context_handler) != ESP_OK) {
+        return 0;
+    }
+    ESP_ERROR_CHECK(onewire_rom_search_context_set_command(context_handler, ONEWIRE_CMD_ALARM_SEARCH_ROM));
 
-    // search for devices on the bus
-    do {
+    // reads are submitted after the search, as the bus worker must not use the bus while it is searched
+    uint8_t alarm_devices[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+    size_t alarm_device_num = 0;
+    while (alarm_device_num < CONFIG_ONEWIRE_NUMBER_OF_DEVICES) {
         esp_err_t search_result = onewire_rom_search(context_handler);
 
         if (search_result == ESP_ERR_INVALID_CRC) {
             continue; // continue on crc error
-        } else if (search_result == ESP_FAIL || search_result == ESP_ERR_NOT_FOUND) {
-            break; // break on finish or no device
+        } else if (search_result != ESP_OK) {
+            break; // break on finish or no device in alarm state
         }
 
-        ESP_ERROR_CHECK(onewire_rom_get_number(context_handler, task_params.device_rom_id[task_params.device_num]));
-        ESP_LOGI(TAG, "found device with rom id " ONEWIRE_ROM_ID_STR,
-                 ONEWIRE_ROM_ID(task_params.device_rom_id[task_params.device_num]));
-        task_params.device_num++;
-    } while (task_params.device_num < CONFIG_ONEWIRE_NUMBER_OF_DEVICES);
+        uint8_t rom_id[8];
+        ESP_ERROR_CHECK(onewire_rom_get_number(context_handler, rom_id));
+        for (size_t device = 0; device < device_num; ++device) {
+            if (devices[device].bus == bus_index && memcmp(devices[device].rom_id, rom_id, sizeof(rom_id)) == 0) {
+                alarm_devices[alarm_device_num++] = device;
+                break;
+            }
+        }
+    }
 
-    // delete 1-wire rom search context
     ESP_ERROR_CHECK(onewire_rom_search_context_delete(context_handler));
-    ESP_LOGI(TAG, "%d device%s found on 1-wire bus", task_params.device_num, task_params.device_num > 1 ? "s" : "");
 
-    if (task_params.device_num > 0) {   
-        temperature_queue = xQueueCreate(task_params.device_num, sizeof(temperature_device_t));
-        if (temperature_queue == NULL) {
-            ESP_LOGE(TAG, "temperature_queue: Queue was not created. Could not allocate required memory");
-            return ESP_ERR_NO_MEM;
+    size_t read_num = 0;
+    for (size_t i = 0; i < alarm_device_num; ++i) {
+        if (ds18b20_submit_device_read_checked(alarm_devices[i])) {
+            read_num++;
+        }
+    }
+    return read_num;
+}
+
+esp_err_t temperature_set_alarm_thresholds(uint8_t device, int8_t alarm_high, int8_t alarm_low)
+{
+    if (device >= device_num || alarm_low > alarm_high) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&devices_lock);
+    devices[device].alarm_high = alarm_high;
+    devices[device].alarm_low = alarm_low;
+    devices[device].is_config_changed = true; // written before the next conversion
+    portEXIT_CRITICAL(&devices_lock);
+
+    char key[16];
+    const int8_t thresholds[2] = { alarm_high, alarm_low };
+    ds18b20_get_alarm_key(devices[device].rom_id, key, sizeof(key));
+    return nvs_write_blob(key, thresholds, sizeof(thresholds));
+}
+#endif
+
+// mark device found by rediscovery as seen, add it if it is new, return true if the device table changed
+static bool ds18b20_rediscovery_seen(uint8_t bus_index, const uint8_t *rom_id)
+{
+    ds18b20_bus_t *bus = &buses[bus_index];
+    bool is_back = false;
+    size_t device = 0;
+
+    portENTER_CRITICAL(&devices_lock);
+    while (device < device_num && (devices[device].bus != bus_index || memcmp(devices[device].rom_id, rom_id, 8) != 0)) {
+        ++device;
+    }
+    if (device < device_num) {
+        devices[device].seen_pass = bus->rediscovery_pass;
+        devices[device].missed_passes = 0;
+        if (!devices[device].is_present) { // recovered device keeps its index
+            devices[device].is_present = true;
+            devices[device].is_config_changed = true; // a swapped device may not be configured yet
+            devices[device].backoff_sweeps = 0; // give it a chance right away, its health is updated by the next read
+            devices[device].is_deadband_changed = true; // publish its first reading after it was lost
+            is_back = true;
+        }
+    }
+    portEXIT_CRITICAL(&devices_lock);
+
+    if (is_back) {
+        ESP_LOGI(TAG, "device %d with rom id " ONEWIRE_ROM_ID_STR " is back on bus %d", device, ONEWIRE_ROM_ID(rom_id), bus_index);
+        return false;
+    }
+
+    bool is_added = false;
+    if (device == device_num && !ds18b20_add_device(bus_index, rom_id, &is_added)) {
+        ESP_LOGW(TAG, "device table is full, increase number of DS18B20 devices");
+    }
+    return is_added;
+}
+
+// a missed presence pulse or a noisy reset can make a single pass look empty, so a device is retired only
+// when this many complete passes in a row did not find it
+#define REDISCOVERY_MISSED_PASSES_TO_RETIRE 2
+
+// retire devices of the bus not found by enough complete rediscovery passes
+static void ds18b20_rediscovery_finish_pass(uint8_t bus_index)
+{
+    ds18b20_bus_t *bus = &buses[bus_index];
+
+    for (size_t device = 0; device < device_num; ++device) {
+        bool is_retired = false;
+
+        portENTER_CRITICAL(&devices_lock);
+        if (devices[device].bus == bus_index && devices[device].is_present &&
+                devices[device].seen_pass != bus->rediscovery_pass &&
+                ++devices[device].missed_passes >= REDISCOVERY_MISSED_PASSES_TO_RETIRE) {
+            devices[device].is_present = false;
+            devices[device].missed_passes = 0;
+            is_retired = true;
+        }
+        portEXIT_CRITICAL(&devices_lock);
+
+        if (is_retired) {
+            ESP_LOGW(TAG, "device %d with rom id " ONEWIRE_ROM_ID_STR " is gone from bus %d", device,
+                     ONEWIRE_ROM_ID(devices[device].rom_id), bus_index);
+        }
+    }
+}
+
+// run a few steps of a ROM search in the gap between sweeps, a whole pass takes as many sweeps as needed
+static void ds18b20_rediscover_devices(uint8_t bus_index)
+{
+    ds18b20_bus_t *bus = &buses[bus_index];
+    bool is_table_changed = false;
+
+    for (size_t step = 0; step < CONFIG_ONEWIRE_REDISCOVERY_DEVICES_PER_SWEEP; ++step) {
+        if (bus->rediscovery == NULL) {
+            if (onewire_rom_search_context_create(bus->handle, &bus->rediscovery) != ESP_OK) {
+                break;
+            }
+            bus->rediscovery_found_num = 0;
+        }
+
+        esp_err_t search_result = onewire_rom_search(bus->rediscovery);
+        if (search_result == ESP_OK) {
+            uint8_t rom_id[8];
+            ESP_ERROR_CHECK(onewire_rom_get_number(bus->rediscovery, rom_id));
+            is_table_changed |= ds18b20_rediscovery_seen(bus_index, rom_id);
+            bus->rediscovery_found_num++;
+            continue;
+        } else if (search_result == ESP_ERR_INVALID_CRC) {
+            continue; // continue on crc error
+        }
+
+        // the pass is complete after the last device, or if no device answers the first reset of the pass,
+        // other errors interrupt the pass and nothing is retired, a single empty pass retires nothing either
+        if (search_result == ESP_FAIL || (search_result == ESP_ERR_NOT_FOUND && bus->rediscovery_found_num == 0)) {
+            ds18b20_rediscovery_finish_pass(bus_index);
+        }
+        ESP_ERROR_CHECK(onewire_rom_search_context_delete(bus->rediscovery));
+        bus->rediscovery = NULL;
+        bus->rediscovery_pass++;
+        break;
+    }
+
+    if (is_table_changed) {
+        ds18b20_save_devices(bus_index);
+    }
+}
+
+static bool ds18b20_is_any_device_present(uint8_t bus_index)
+{
+    for (size_t device = 0; device < device_num; ++device) {
+        if (devices[device].bus == bus_index && devices[device].is_present) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// highest resolution the present devices of a bus convert with, devices not configured yet may use any
+static ds18b20_resolution_t ds18b20_get_bus_resolution(uint8_t bus_index)
+{
+    ds18b20_resolution_t bus_resolution = DS18B20_RESOLUTION_9B;
+
+    portENTER_CRITICAL(&devices_lock);
+    for (size_t device = 0; device < device_num; ++device) {
+        if (devices[device].bus != bus_index || !devices[device].is_present) {
+            continue;
+        }
+        if (devices[device].is_config_changed) {
+            bus_resolution = DS18B20_RESOLUTION_12B;
+            break;
+        }
+        if (devices[device].resolution > bus_resolution) { // configuration register grows with resolution
+            bus_resolution = devices[device].resolution;
+        }
+    }
+    portEXIT_CRITICAL(&devices_lock);
+
+    return bus_resolution;
+}
+
+// configure devices and trigger conversion, return false if there is nothing to convert
+static bool ds18b20_start_conversion(uint8_t bus_index)
+{
+    if (!ds18b20_is_any_device_present(bus_index)) {
+        return false; // nothing to convert until rediscovery finds a device
+    }
+
+    // configuration is kept in EEPROM, so this only writes to new, changed or reset devices
+    ds18b20_configure_devices(bus_index);
+
+    // trigger all sensors to start temperature conversion
+    buses[bus_index].conversion_timestamp_us = esp_timer_get_time();
+    buses[bus_index].conversion_unix_time_ms = time_sync_get_unix_time_ms();
+    esp_err_t err = ds18b20_trigger_temperature_conversion(buses[bus_index].handle, NULL); // skip rom to send command to all devices on the bus
+    return err == ESP_OK;
+}
+
+// wait for the conversion and submit reads of the devices, return the number submitted,
+// their samples are sent to the processing task as the reads complete
+static size_t ds18b20_finish_conversion(uint8_t bus_index)
+{
+    // converting devices hold read slots low, read as soon as the slowest one is done
+    esp_err_t err = ds18b20_wait_for_conversion(buses[bus_index].handle, ds18b20_get_bus_resolution(bus_index));
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Conversion on bus %d not done in time: %s", bus_index, esp_err_to_name(err));
+        // read anyway, a device that did not convert is caught by CRC or power-on value check
+    }
+
+    // get temperature from sensors of this bus
+#if CONFIG_ONEWIRE_ALARM_MODE
+    if (buses[bus_index].conversion_count++ % CONFIG_ONEWIRE_ALARM_FULL_SWEEP_INTERVAL == 0) {
+        return ds18b20_submit_bus_reads(bus_index);
+    }
+    return ds18b20_submit_alarm_reads(bus_index);
+#else
+    return ds18b20_submit_bus_reads(bus_index);
+#endif
+}
+
+// one task drives all buses: conversions are started one after the other and overlap in time, the reads of a bus
+// are submitted as soon as its conversion is done and run on its bus worker task, so the buses are read in parallel
+// and a device that does not answer only delays its own bus
+static void ds18b20_task(void *params)
+{
+#if !CONFIG_ONEWIRE_MAX_RATE
+    TickType_t last_wake_time = xTaskGetTickCount();
+#endif
+    bool is_converting[CONFIG_ONEWIRE_NUMBER_OF_BUSES];
+
+    // convert and read temperature
+    while (true) {
+        bool is_any_converting = false;
+        for (uint8_t bus_index = 0; bus_index < CONFIG_ONEWIRE_NUMBER_OF_BUSES; ++bus_index) {
+            is_converting[bus_index] = ds18b20_start_conversion(bus_index);
+            is_any_converting |= is_converting[bus_index];
+        }
+
+        size_t read_num = 0;
+        for (uint8_t bus_index = 0; bus_index < CONFIG_ONEWIRE_NUMBER_OF_BUSES; ++bus_index) {
+            if (is_converting[bus_index]) {
+                read_num += ds18b20_finish_conversion(bus_index);
+            }
+        }
+        ds18b20_wait_for_reads(read_num);
+        if (is_any_converting) {
+            ds18b20_send_sweep_end();
+        }
+
+        // look for added, removed and recovered devices while the buses are idle anyway
+        for (uint8_t bus_index = 0; bus_index < CONFIG_ONEWIRE_NUMBER_OF_BUSES; ++bus_index) {
+            ds18b20_rediscover_devices(bus_index);
+        }
+
+#if CONFIG_ONEWIRE_MAX_RATE
+        if (!is_any_converting) {
+            vTaskDelay(pdMS_TO_TICKS(ds18b20_get_conversion_time_ms(DEFAULT_RESOLUTION))); // keep rediscovering empty buses at sweep pace
+        }
+#else
+        // period is measured from conversion start, so read and rediscovery time does not add up
+        xTaskDelayUntil(&last_wake_time, pdMS_TO_TICKS(CONFIG_ONEWIRE_TEMPERATURE_UPDATE_TIME * 1000));
+#endif
+    }
+}
+
+typedef struct {
+    int16_t temperature; // last published temperature
+    int64_t timestamp_us; // conversion time of the last published temperature
+    bool is_published; // something was published since boot or deadband change
+} ds18b20_published_t;
+
+// decide if a filtered temperature is published, it is if it left the deadband, the device was silent
+// for the heartbeat interval, or nothing was published yet, so a steady device can be told from a dead one
+static bool ds18b20_is_publish_due(ds18b20_published_t *published, const temperature_device_t *value)
+{
+    portENTER_CRITICAL(&devices_lock);
+    temperature_deadband_t deadband = devices[value->device].deadband;
+    if (devices[value->device].is_deadband_changed) {
+        published->is_published = false;
+        devices[value->device].is_deadband_changed = false;
+    }
+    portEXIT_CRITICAL(&devices_lock);
+
+    if (!published->is_published) {
+        return true;
+    }
+
+    if (deadband.heartbeat_interval != 0 &&
+        value->timestamp_us - published->timestamp_us >= (int64_t)deadband.heartbeat_interval * 1000000) {
+        return true;
+    }
+
+    int32_t change = abs(value->temperature - published->temperature);
+    return change > deadband.absolute && change * 100 > (int32_t)deadband.percent * abs(published->temperature);
+}
+
+// filter samples of all buses and queue temperatures due to be published
+static void ds18b20_process_task(void *params)
+{
+    static filter_t filters[CONFIG_ONEWIRE_NUMBER_OF_DEVICES]; // only this task touches filter state
+    static ds18b20_published_t published[CONFIG_ONEWIRE_NUMBER_OF_DEVICES];
+    temperature_device_t sample;
+
+    while (true) {
+        if (xQueueReceive(sample_queue, &sample, portMAX_DELAY) != pdPASS) {
+            continue;
+        }
+
+        if (sample.device == SAMPLE_SWEEP_END) {
+            atomic_store(&is_sweep_ended, true);
+            TaskHandle_t consumer = temperature_consumer;
+            if (consumer != NULL) {
+                xTaskNotifyGive(consumer);
+            }
+            continue;
         }
-        
-        BaseType_t status = xTaskCreate(ds18b20_task, "ds18b20_task", configMINIMAL_STACK_SIZE * 4, &task_params,
-                                        PRIORITY_HIGH, NULL);
-        if (status != pdPASS) {
-            ESP_LOGE(TAG, "ds18b20_task(): Task was not created. Could not allocate required memory");
-            return ESP_ERR_NO_MEM;
+
+        portENTER_CRITICAL(&devices_lock);
+        bool is_filter_changed = devices[sample.device].is_filter_changed;
+        filter_config_t filter_config = devices[sample.device].filter_config;
+        devices[sample.device].is_filter_changed = false;
+        portEXIT_CRITICAL(&devices_lock);
+
+        if (is_filter_changed) {
+            filter_init(&filters[sample.device], &filter_config); // config is checked when it is set
         }
+
+        history_add(sample.device, sample.temperature, sample.timestamp_us); // history keeps unfiltered readings
+
+        int16_t temperature = filter_update(&filters[sample.device], sample.temperature);
+
+        temperature_device_t temperature_device_to_send = sample;
+        temperature_device_to_send.temperature = temperature; // filtered value is stamped with its latest reading
+
+        if (ds18b20_is_publish_due(&published[sample.device], &temperature_device_to_send)) {
+            temperature_slot_write(&temperature_device_to_send);
+            published[sample.device] = (ds18b20_published_t) {
+                .temperature = temperature,
+                .timestamp_us = sample.timestamp_us,
+                .is_published = true,
+            };
+        }
+    }
+}
+
+#if !CONFIG_ONEWIRE_BUS_SIMULATED
+// ESP32 has 8 RMT memory blocks and no rx ping-pong, so a receive must fit the rx blocks: with up to 2 buses
+// 1 tx + 3 rx blocks each fit a whole scratchpad read in one receive, more buses get 1 rx block and split reads
+#if CONFIG_ONEWIRE_NUMBER_OF_BUSES <= 2
+#define ONEWIRE_RX_MEM_BLOCK_NUM 3
+#else
+#define ONEWIRE_RX_MEM_BLOCK_NUM 1
+#endif
+#endif
+
+static esp_err_t ds18b20_bus_init(uint8_t bus_index)
+{
+    ds18b20_bus_t *bus = &buses[bus_index];
+
+#if CONFIG_ONEWIRE_BUS_SIMULATED
+    onewire_sim_config_t config = {
+        .devices = NULL, // generate DS18B20 ROM numbers
+        .device_num = CONFIG_ONEWIRE_SIM_DEVICES_PER_BUS,
+        .request_queue_depth = CONFIG_ONEWIRE_NUMBER_OF_DEVICES, // a read of each device can be pending
+    };
+
+    // install new simulated 1-wire bus
+    ESP_ERROR_CHECK(onewire_new_bus_sim(&config, &bus->handle));
+    ESP_LOGI(TAG, "1-wire bus %d simulated with %d devices", bus_index, CONFIG_ONEWIRE_SIM_DEVICES_PER_BUS);
+#else
+    onewire_rmt_config_t config = {
+        .gpio_pin = bus->gpio_pin,
+        .max_rx_bytes = 19, // 10 tx bytes (1byte ROM command + 8byte ROM number + 1byte device command) + 9byte scratchpad
+        .rx_mem_block_num = ONEWIRE_RX_MEM_BLOCK_NUM,
+        .request_queue_depth = CONFIG_ONEWIRE_NUMBER_OF_DEVICES, // a read of each device can be pending
+    };
+
+    // install new 1-wire bus
+    ESP_ERROR_CHECK(onewire_new_bus_rmt(&config, &bus->handle));
+    ESP_LOGI(TAG, "1-wire bus %d installed on GPIO %d", bus_index, bus->gpio_pin);
+#endif
+
+    // check devices stored in NVS by addressing each of them, search the bus only if one is missing
+    int64_t search_start_time = esp_timer_get_time();
+    if (ds18b20_restore_devices(bus_index)) {
+        ESP_LOGI(TAG, "%d device%s restored on 1-wire bus %d in %lld ms", bus->device_num, bus->device_num > 1 ? "s" : "",
+                 bus_index, (esp_timer_get_time() - search_start_time) / 1000);
     } else {
-        ESP_ERROR_CHECK(onewire_del_bus(task_params.handle));
-        ESP_LOGI(TAG, "1-wire bus deleted");
+        ds18b20_search_devices(bus_index);
+        ds18b20_save_devices(bus_index);
+        ESP_LOGI(TAG, "%d device%s found on 1-wire bus %d in %lld ms", bus->device_num, bus->device_num > 1 ? "s" : "",
+                 bus_index, (esp_timer_get_time() - search_start_time) / 1000);
+    }
+
+    // devices found so far were seen by pass 0, the sampling task runs rediscovery from pass 1 on
+    bus->rediscovery_pass = 1;
+
+    return ESP_OK;
+}
+
+esp_err_t ds18b20_init(void)
+{
+    ESP_ERROR_CHECK(history_init());
+
+    // devices are numbered in bus order, so indices do not depend on which bus answers first
+    for (uint8_t bus_index = 0; bus_index < CONFIG_ONEWIRE_NUMBER_OF_BUSES; ++bus_index) {
+        ESP_ERROR_CHECK(ds18b20_bus_init(bus_index));
+    }
+
+    // a sample per device of each bus can wait, while every bus starts its next conversion
+    sample_queue = xQueueCreate(CONFIG_ONEWIRE_NUMBER_OF_DEVICES * 2, sizeof(temperature_device_t));
+    if (sample_queue == NULL) {
+        ESP_LOGE(TAG, "sample_queue: Queue was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // below the sampling task, so processing never delays a conversion
+    BaseType_t status = xTaskCreate(ds18b20_process_task, "ds18b20_process", configMINIMAL_STACK_SIZE * 4, NULL,
+                                    PRIORITY_MIDDLE, NULL);
+    if (status != pdPASS) {
+        ESP_LOGE(TAG, "ds18b20_process_task(): Task was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // reads of all buses complete into one queue, each device has at most one read pending
+    read_done_queue = xQueueCreate(CONFIG_ONEWIRE_NUMBER_OF_DEVICES, sizeof(ds18b20_pending_read_t *));
+    if (read_done_queue == NULL) {
+        ESP_LOGE(TAG, "read_done_queue: Queue was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
+    }
+
+    // one task drives all buses, bus I/O runs on the worker task of each bus,
+    // buses without devices are kept, so that devices plugged in later are found
+    status = xTaskCreate(ds18b20_task, "ds18b20_task", configMINIMAL_STACK_SIZE * 4, NULL, PRIORITY_HIGH, NULL);
+    if (status != pdPASS) {
+        ESP_LOGE(TAG, "ds18b20_task(): Task was not created. Could not allocate required memory");
+        return ESP_ERR_NO_MEM;
     }
 
     ESP_LOGI(TAG, "ds18b20_init() finished");
@@ -0,0 +1,47 @@
+#include "time_sync.h"
+
+#include <stdbool.h>
+#include <sys/time.h>
+
+#include "esp_log.h"
+#include "esp_sntp.h"
+
+#include "sdkconfig.h"
+
+static const char *TAG = "time_sync";
+
+static volatile bool is_synced = false;
+
+static void time_sync_notification_cb(struct timeval *tv)
+{
+    is_synced = true;
+    ESP_LOGI(TAG, "Time synchronized with %s", CONFIG_SNTP_SERVER);
+}
+
+esp_err_t time_sync_init(void)
+{
+    // SNTP keeps polling the server in the background and corrects the system time
+    sntp_setoperatingmode(SNTP_OPMODE_POLL);
+    sntp_setservername(0, CONFIG_SNTP_SERVER);
+    sntp_set_time_sync_notification_cb(time_sync_notification_cb);
+    sntp_init();
+
+    ESP_LOGI(TAG, "time_sync_init() finished");
+    return ESP_OK;
+}
+
+bool time_sync_is_synced(void)
+{
+    return is_synced;
+}
+
+int64_t time_sync_get_unix_time_ms(void)
+{
+    if (!is_synced) {
+        return 0; // time since boot would look like 1970
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (int64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
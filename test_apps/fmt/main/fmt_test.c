@@ -0,0 +1,57 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unity.h"
+#include "fmt.h"
+
+// check both the string and the returned length, temperature in 1/16 °C
+static void test_temperature(const char *expected, int16_t temperature, uint8_t decimals)
+{
+    char buffer[FMT_TEMPERATURE_LENGTH_MAX];
+    size_t length = fmt_temperature(buffer, temperature, decimals);
+    TEST_ASSERT_EQUAL_STRING(expected, buffer);
+    TEST_ASSERT_EQUAL(strlen(expected), length);
+}
+
+TEST_CASE("negative temperature rounded to zero has no sign", "[fmt]")
+{
+    test_temperature("0", -1, 0);
+    test_temperature("0", -7, 0);
+    test_temperature("0.0000", 0, 4);
+    test_temperature("-0.1", -1, 1); // -0.0625 rounds away from zero
+    test_temperature("-0.06", -1, 2);
+    test_temperature("-0.0625", -1, 4);
+}
+
+TEST_CASE("int16 extremes fit the buffer", "[fmt]")
+{
+    test_temperature("-2048.0000", INT16_MIN, FMT_TEMPERATURE_DECIMALS_MAX);
+    test_temperature("2047.9375", INT16_MAX, FMT_TEMPERATURE_DECIMALS_MAX);
+    test_temperature("-2048", INT16_MIN, 0);
+    test_temperature("2048", INT16_MAX, 0);
+    test_temperature("2047.9375", INT16_MAX, FMT_TEMPERATURE_DECIMALS_MAX + 1); // more decimals are not exact
+}
+
+TEST_CASE("halves are rounded away from zero", "[fmt]")
+{
+    test_temperature("1", 8, 0); // 0.5
+    test_temperature("-1", -8, 0);
+    test_temperature("2", 24, 0); // 1.5
+    test_temperature("-2", -24, 0);
+    test_temperature("3", 40, 0); // 2.5, not to even
+    test_temperature("-3", -40, 0);
+    test_temperature("0.063", 1, 3); // 0.0625
+    test_temperature("-0.063", -1, 3);
+    test_temperature("0.19", 3, 2); // 0.1875
+    test_temperature("-0.19", -3, 2);
+    test_temperature("0.4", 7, 1); // 0.4375 is below the half
+    test_temperature("-0.4", -7, 1);
+    test_temperature("25.06", 401, 2); // 25.0625
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    exit(UNITY_END() ? 1 : 0);
+}
@@ -0,0 +1,174 @@
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "fmt.h"
+
+#define BENCHMARK_ITERATIONS 200000
+#define BENCHMARK_RUNS 5 // best run is reported, so other processes on the host skew it less
+
+typedef struct {
+    int16_t temperature;
+    int64_t timestamp_us;
+    int64_t unix_time_ms;
+    int64_t latency_ms;
+} benchmark_reading_t;
+
+typedef size_t (*benchmark_function_t)(char *string, size_t size, const benchmark_reading_t *reading);
+
+static const char *cycle_unit = "cycles";
+
+// TSC on x86, nanoseconds elsewhere
+static inline uint64_t benchmark_get_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    cycle_unit = "ns";
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+// same fields as temperature_to_json() in main/mqtt.c
+static size_t json_with_fmt(char *string, size_t size, const benchmark_reading_t *reading)
+{
+    fmt_writer_t writer;
+    fmt_writer_init(&writer, string, size);
+    fmt_write_string(&writer, "{\"temperature\":");
+    fmt_write_temperature(&writer, reading->temperature, 1);
+    fmt_write_string(&writer, ",\"uptime_us\":");
+    fmt_write_int(&writer, reading->timestamp_us);
+    fmt_write_string(&writer, ",\"time_ms\":");
+    fmt_write_int(&writer, reading->unix_time_ms);
+    fmt_write_string(&writer, ",\"latency_ms\":");
+    fmt_write_int(&writer, reading->latency_ms);
+    fmt_write_string(&writer, "}");
+    return writer.is_overflow ? 0 : writer.length;
+}
+
+// the same message as it was written before fmt, with float printf
+static size_t json_with_snprintf(char *string, size_t size, const benchmark_reading_t *reading)
+{
+    int length = snprintf(string, size, "{\"temperature\":%.1f,\"uptime_us\":%lld,\"time_ms\":%lld,\"latency_ms\":%lld}",
+                          reading->temperature / 16.0f, (long long)reading->timestamp_us,
+                          (long long)reading->unix_time_ms, (long long)reading->latency_ms);
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+static size_t plain_with_fmt(char *string, size_t size, const benchmark_reading_t *reading)
+{
+    return size >= FMT_TEMPERATURE_LENGTH_MAX ? fmt_temperature(string, reading->temperature, 1) : 0;
+}
+
+static size_t plain_with_snprintf(char *string, size_t size, const benchmark_reading_t *reading)
+{
+    int length = snprintf(string, size, "%.1f", reading->temperature / 16.0f);
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+static size_t int_with_fmt(char *string, size_t size, const benchmark_reading_t *reading)
+{
+    return size >= FMT_INT_LENGTH_MAX ? fmt_int(string, reading->unix_time_ms) : 0;
+}
+
+static size_t int_with_snprintf(char *string, size_t size, const benchmark_reading_t *reading)
+{
+    int length = snprintf(string, size, "%lld", (long long)reading->unix_time_ms);
+    return length > 0 && (size_t)length < size ? (size_t)length : 0;
+}
+
+static benchmark_reading_t readings[256];
+
+// readings across the DS18B20 range with realistic timestamps
+static void benchmark_init_readings(void)
+{
+    for (size_t i = 0; i < sizeof(readings) / sizeof(readings[0]); ++i) {
+        readings[i] = (benchmark_reading_t) {
+            .temperature = (int16_t)(-55 * 16 + (int32_t)i * 2867 % (180 * 16)),
+            .timestamp_us = 3600000000LL + (int64_t)i * 750123,
+            .unix_time_ms = 1697500000123LL + (int64_t)i * 750,
+            .latency_ms = (int64_t)i % 900,
+        };
+    }
+}
+
+// return best cycles per message of BENCHMARK_RUNS runs
+static double benchmark_run(benchmark_function_t function)
+{
+    static char string[128];
+    const size_t reading_num = sizeof(readings) / sizeof(readings[0]);
+    double best = 0;
+    size_t total_length = 0;
+
+    for (int run = 0; run < BENCHMARK_RUNS; ++run) {
+        uint64_t start = benchmark_get_cycles();
+        for (size_t i = 0; i < BENCHMARK_ITERATIONS; ++i) {
+            total_length += function(string, sizeof(string), &readings[i % reading_num]);
+        }
+        double cycles = (double)(benchmark_get_cycles() - start) / BENCHMARK_ITERATIONS;
+        if (run == 0 || cycles < best) {
+            best = cycles;
+        }
+    }
+
+    if (total_length == 0) {
+        printf("nothing was written\n"); // also keeps the loop from being optimized away
+    }
+    return best;
+}
+
+// integers must match printf exactly, temperatures are not compared as fmt rounds half away from zero
+// and printf rounds the binary value half to even
+static bool benchmark_check_ints(void)
+{
+    static const int64_t values[] = { 0, 1, -1, 9, 10, 999999999, 1000000000, 4294967295LL, 4294967296LL,
+                                      1697500000123LL, -1697500000123LL, INT64_MAX, INT64_MIN };
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+        char expected[32];
+        char written[FMT_INT_LENGTH_MAX];
+        snprintf(expected, sizeof(expected), "%" PRId64, values[i]);
+        fmt_int(written, values[i]);
+        if (strcmp(expected, written) != 0) {
+            printf("fmt_int() wrote %s instead of %s\n", written, expected);
+            return false;
+        }
+    }
+    return true;
+}
+
+void app_main(void)
+{
+    static const struct {
+        const char *name;
+        benchmark_function_t fmt;
+        benchmark_function_t printf;
+    } cases[] = {
+        { "json", json_with_fmt, json_with_snprintf },
+        { "plain", plain_with_fmt, plain_with_snprintf },
+        { "int64", int_with_fmt, int_with_snprintf },
+    };
+
+    if (!benchmark_check_ints()) {
+        exit(1);
+    }
+    benchmark_init_readings();
+
+    printf("%-8s %12s %12s %8s\n", "message", "fmt", "snprintf", "speedup");
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        double fmt_cycles = benchmark_run(cases[i].fmt);
+        double printf_cycles = benchmark_run(cases[i].printf);
+        printf("%-8s %12.1f %12.1f %7.1fx\n", cases[i].name, fmt_cycles, printf_cycles, printf_cycles / fmt_cycles);
+    }
+    printf("%s per message, best of %d runs of %d messages\n", cycle_unit, BENCHMARK_RUNS, BENCHMARK_ITERATIONS);
+    exit(0);
+}
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "esp_partition.h"
+#include "unity.h"
+#include "journal.h"
+
+// record layout of journal.c, a reboot is simulated by running journal_init() again
+#define TEST_RECORD_SIZE 32
+#define TEST_STATE_OFFSET 0
+#define TEST_SEQUENCE_OFFSET 4
+#define TEST_STATE_WRITTEN 0xF0
+#define TEST_STATE_COMMITTED 0x00
+
+#define TEST_DEVICE_NUM 2
+
+static const uint8_t test_rom_ids[TEST_DEVICE_NUM][8] = {
+    { 0x28, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x9A },
+    { 0x28, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x3B },
+};
+
+// the journal only needs the ROM ID of a device and the device of a ROM ID
+esp_err_t temperature_get_info(uint8_t device, temperature_info_t *info)
+{
+    if (device >= TEST_DEVICE_NUM) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(info->rom_id, test_rom_ids[device], sizeof(info->rom_id));
+    info->resolution = DS18B20_RESOLUTION_12B;
+    return ESP_OK;
+}
+
+esp_err_t temperature_find_device(const uint8_t *rom_id, uint8_t *device)
+{
+    for (uint8_t i = 0; i < TEST_DEVICE_NUM; i ++) {
+        if (memcmp(test_rom_ids[i], rom_id, 8) == 0) {
+            *device = i;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+static const esp_partition_t *test_erase_journal(void)
+{
+    const esp_partition_t *partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, "journal");
+    TEST_ASSERT_NOT_NULL(partition);
+    TEST_ESP_OK(esp_partition_erase_range(partition, 0, partition->size));
+    return partition;
+}
+
+static void test_append(uint8_t device, int16_t temperature)
+{
+    const temperature_device_t value = {
+        .device = device,
+        .temperature = temperature,
+        .timestamp_us = 1000 + temperature,
+        .unix_time_ms = 1700000000000 + temperature,
+    };
+    TEST_ESP_OK(journal_append(&value));
+}
+
+static void test_read_slot(const esp_partition_t *partition, size_t slot, uint8_t *state, uint32_t *sequence)
+{
+    uint8_t record[TEST_RECORD_SIZE];
+    TEST_ESP_OK(esp_partition_read(partition, slot * TEST_RECORD_SIZE, record, sizeof(record)));
+    *state = record[TEST_STATE_OFFSET];
+    memcpy(sequence, &record[TEST_SEQUENCE_OFFSET], sizeof(*sequence));
+}
+
+TEST_CASE("committed readings keep head and sequence after reboot", "[journal]")
+{
+    const esp_partition_t *partition = test_erase_journal();
+    temperature_device_t values[4];
+
+    TEST_ESP_OK(journal_init());
+    test_append(0, 100);
+    test_append(1, 200);
+    test_append(0, 300);
+    TEST_ASSERT_EQUAL(3, journal_read_batch(values, 4));
+    TEST_ESP_OK(journal_commit_batch());
+    TEST_ASSERT_EQUAL(0, journal_get_count());
+
+    TEST_ESP_OK(journal_init());
+    TEST_ASSERT_EQUAL(0, journal_get_count());
+
+    // the next reading goes after the committed ones and continues their sequence
+    test_append(1, 400);
+    for (size_t slot = 0; slot < 4; slot ++) {
+        uint8_t state;
+        uint32_t sequence;
+        test_read_slot(partition, slot, &state, &sequence);
+        TEST_ASSERT_EQUAL_HEX8(slot < 3 ? TEST_STATE_COMMITTED : TEST_STATE_WRITTEN, state);
+        TEST_ASSERT_EQUAL_UINT32(slot, sequence);
+    }
+
+    TEST_ASSERT_EQUAL(1, journal_read_batch(values, 4));
+    TEST_ASSERT_EQUAL(1, values[0].device);
+    TEST_ASSERT_EQUAL_INT16(400, values[0].temperature);
+}
+
+TEST_CASE("readings not committed are replayed after reboot", "[journal]")
+{
+    test_erase_journal();
+    temperature_device_t values[4];
+
+    TEST_ESP_OK(journal_init());
+    test_append(1, -50);
+    test_append(0, 75);
+    TEST_ASSERT_EQUAL(2, journal_read_batch(values, 4)); // broker never acknowledged them
+
+    TEST_ESP_OK(journal_init());
+    TEST_ASSERT_EQUAL(2, journal_get_count());
+    TEST_ASSERT_EQUAL(2, journal_read_batch(values, 4));
+    TEST_ASSERT_EQUAL(1, values[0].device);
+    TEST_ASSERT_EQUAL_INT16(-50, values[0].temperature);
+    TEST_ASSERT_EQUAL(0, values[0].timestamp_us); // esp_timer time of an earlier boot is meaningless
+    TEST_ASSERT_EQUAL_INT64(1700000000000 - 50, values[0].unix_time_ms);
+    TEST_ASSERT_EQUAL(0, values[1].device);
+    TEST_ESP_OK(journal_commit_batch());
+
+    TEST_ESP_OK(journal_init());
+    TEST_ASSERT_EQUAL(0, journal_get_count());
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    exit(UNITY_END() ? 1 : 0);
+}
@@ -0,0 +1,281 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "unity.h"
+#include "onewire_bus.h"
+#include "onewire_bus_sim.h"
+
+// 1-wire timing the simulated bus has to report, in us
+#define TEST_RESET_US 960 // reset pulse and presence detection
+#define TEST_SLOT_US 64 // one read or write slot
+
+#define TEST_DEVICE_NUM 128 // the most devices the application supports on one bus
+#define TEST_OPERATION_GAP_US 100 // assumed time between two bus operations, e.g. RMT transactions
+#define TEST_CONVERSION_US 750000 // 12 bit conversion
+
+#define TEST_CMD_CONVERT_T 0x44
+#define TEST_CMD_READ_SCRATCHPAD 0xBE
+#define TEST_POWER_ON_RAW_TEMPERATURE 0x0550 // 85 °C, scratchpad before the first conversion
+
+static onewire_bus_handle_t test_new_bus(size_t device_num)
+{
+    onewire_sim_config_t config = {
+        .devices = NULL, // generated ROM numbers
+        .device_num = device_num,
+    };
+    onewire_bus_handle_t bus = NULL;
+    TEST_ESP_OK(onewire_new_bus_sim(&config, &bus));
+    return bus;
+}
+
+// run full ROM search, return number of devices found
+static size_t test_search(onewire_bus_handle_t bus, uint8_t (*rom_numbers)[8], size_t rom_number_max)
+{
+    onewire_rom_search_context_handler_t context;
+    size_t found = 0;
+
+    TEST_ESP_OK(onewire_rom_search_context_create(bus, &context));
+    while (found < rom_number_max && onewire_rom_search(context) == ESP_OK) {
+        TEST_ESP_OK(onewire_rom_get_number(context, rom_numbers[found ++]));
+    }
+    TEST_ESP_OK(onewire_rom_search_context_delete(context));
+
+    return found;
+}
+
+static bool test_is_found(uint8_t (*rom_numbers)[8], size_t found, const uint8_t *rom_number)
+{
+    for (size_t i = 0; i < found; i ++) {
+        if (memcmp(rom_numbers[i], rom_number, 8) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static esp_err_t test_read_scratchpad(onewire_bus_handle_t bus, const uint8_t *rom_number, uint8_t *scratchpad, bool *crc_valid)
+{
+    uint8_t tx[10] = { ONEWIRE_CMD_MATCH_ROM };
+    memcpy(&tx[1], rom_number, 8);
+    tx[9] = TEST_CMD_READ_SCRATCHPAD;
+    return onewire_bus_transact(bus, tx, sizeof(tx), scratchpad, 9, crc_valid);
+}
+
+// every search pass is a reset, the command byte and 64 triplets of 3 slots
+TEST_CASE("search 128 devices in reported bus time", "[onewire_sim]")
+{
+    static uint8_t rom_numbers[TEST_DEVICE_NUM][8];
+    onewire_bus_handle_t bus = test_new_bus(TEST_DEVICE_NUM);
+
+    TEST_ASSERT_EQUAL(TEST_DEVICE_NUM, test_search(bus, rom_numbers, TEST_DEVICE_NUM));
+    for (size_t i = 0; i < TEST_DEVICE_NUM; i ++) {
+        uint8_t rom_number[8];
+        TEST_ESP_OK(onewire_sim_get_rom_number(bus, i, rom_number));
+        TEST_ASSERT_TRUE(test_is_found(rom_numbers, TEST_DEVICE_NUM, rom_number));
+    }
+    TEST_ASSERT_EQUAL_UINT64(TEST_DEVICE_NUM * (TEST_RESET_US + (8 + 64 * 3) * TEST_SLOT_US),
+                             onewire_sim_get_bus_time_us(bus));
+
+    TEST_ESP_OK(onewire_del_bus(bus));
+}
+
+// a search pass is one transaction and 64 triplets natively, a reset, a byte write and 3 bits per ROM bit otherwise
+TEST_CASE("search triplet saves operations of 128 device search", "[onewire_sim]")
+{
+    static uint8_t rom_numbers[2][TEST_DEVICE_NUM][8];
+    static onewire_sim_device_config_t devices[TEST_DEVICE_NUM]; // same devices on both buses
+    uint64_t bus_time_us[2];
+
+    for (size_t is_step_by_step = 0; is_step_by_step < 2; is_step_by_step ++) {
+        onewire_sim_config_t config = {
+            .devices = is_step_by_step ? devices : NULL, // generated ROM numbers on the first bus
+            .device_num = TEST_DEVICE_NUM,
+            .operation_gap_us = TEST_OPERATION_GAP_US,
+            .is_step_by_step = is_step_by_step,
+        };
+        onewire_bus_handle_t bus = NULL;
+        TEST_ESP_OK(onewire_new_bus_sim(&config, &bus));
+        for (size_t i = 0; i < TEST_DEVICE_NUM && !is_step_by_step; i ++) {
+            TEST_ESP_OK(onewire_sim_get_rom_number(bus, i, devices[i].rom_number));
+        }
+        TEST_ASSERT_EQUAL(TEST_DEVICE_NUM, test_search(bus, rom_numbers[is_step_by_step], TEST_DEVICE_NUM));
+        bus_time_us[is_step_by_step] = onewire_sim_get_bus_time_us(bus);
+        TEST_ESP_OK(onewire_del_bus(bus));
+    }
+
+    // same ROM numbers in the same order, same slots, fewer operations
+    TEST_ASSERT_EQUAL_MEMORY(rom_numbers[0], rom_numbers[1], sizeof(rom_numbers[0]));
+    const uint64_t slot_time_us = TEST_DEVICE_NUM * (TEST_RESET_US + (8 + 64 * 3) * TEST_SLOT_US);
+    TEST_ASSERT_EQUAL_UINT64(slot_time_us + TEST_DEVICE_NUM * (1 + 64) * TEST_OPERATION_GAP_US, bus_time_us[0]);
+    TEST_ASSERT_EQUAL_UINT64(slot_time_us + TEST_DEVICE_NUM * (2 + 64 * 3) * TEST_OPERATION_GAP_US, bus_time_us[1]);
+    printf("search of %d devices: %llu us with triplet, %llu us without\n", TEST_DEVICE_NUM,
+           (unsigned long long)bus_time_us[0], (unsigned long long)bus_time_us[1]);
+}
+
+static int64_t test_now_us; // conversions run on this clock, so tests do not depend on wall-clock time
+
+static int64_t test_clock(void)
+{
+    return test_now_us;
+}
+
+// one sweep is a conversion of all devices with SKIP ROM, then a MATCH ROM and scratchpad read per device
+TEST_CASE("sweep 128 devices in reported bus time", "[onewire_sim]")
+{
+    onewire_sim_config_t config = {
+        .devices = NULL, // generated ROM numbers
+        .device_num = TEST_DEVICE_NUM,
+        .now_us = test_clock,
+    };
+    onewire_bus_handle_t bus = NULL;
+    TEST_ESP_OK(onewire_new_bus_sim(&config, &bus));
+    uint8_t rom_numbers[TEST_DEVICE_NUM][8];
+
+    for (size_t i = 0; i < TEST_DEVICE_NUM; i ++) {
+        TEST_ESP_OK(onewire_sim_get_rom_number(bus, i, rom_numbers[i]));
+        TEST_ESP_OK(onewire_sim_set_temperature(bus, i, (int16_t)(i * 13 - 500)));
+    }
+
+    uint64_t start_us = onewire_sim_get_bus_time_us(bus);
+    const uint8_t convert[] = { ONEWIRE_CMD_SKIP_ROM, TEST_CMD_CONVERT_T };
+    TEST_ESP_OK(onewire_bus_transact(bus, convert, sizeof(convert), NULL, 0, NULL));
+
+    // devices hold the bus low until conversion is done, on the clock and not in bus time
+    uint8_t bit = 1;
+    test_now_us += TEST_CONVERSION_US - 1;
+    TEST_ESP_OK(onewire_bus_read_bit(bus, &bit));
+    TEST_ASSERT_EQUAL(0, bit);
+    test_now_us += 1;
+    TEST_ESP_OK(onewire_bus_read_bit(bus, &bit));
+    TEST_ASSERT_EQUAL(1, bit);
+
+    for (size_t i = 0; i < TEST_DEVICE_NUM; i ++) {
+        uint8_t scratchpad[9];
+        bool crc_valid = false;
+        TEST_ESP_OK(test_read_scratchpad(bus, rom_numbers[i], scratchpad, &crc_valid));
+        TEST_ASSERT_TRUE(crc_valid);
+        TEST_ASSERT_EQUAL_INT16((int16_t)(i * 13 - 500), (int16_t)(scratchpad[0] | scratchpad[1] << 8));
+    }
+    TEST_ASSERT_EQUAL_UINT64(TEST_RESET_US + (2 * 8 + 2) * TEST_SLOT_US +
+                             TEST_DEVICE_NUM * (TEST_RESET_US + (10 + 9) * 8 * TEST_SLOT_US),
+                             onewire_sim_get_bus_time_us(bus) - start_us);
+
+    TEST_ESP_OK(onewire_del_bus(bus));
+}
+
+static QueueHandle_t test_done_queue;
+
+// runs in the bus worker task
+static void test_request_done(onewire_bus_handle_t bus, onewire_bus_request_t *request, esp_err_t result)
+{
+    request->user_ctx = (void *)(intptr_t)result;
+    xQueueSend(test_done_queue, &request, 0);
+}
+
+// a sweep submitted at once completes in submission order, without the caller waiting on the bus
+TEST_CASE("submitted reads complete in order", "[onewire_sim]")
+{
+    onewire_sim_config_t config = {
+        .devices = NULL, // generated ROM numbers
+        .device_num = 4,
+        .request_queue_depth = 4,
+    };
+    onewire_bus_handle_t bus = NULL;
+    TEST_ESP_OK(onewire_new_bus_sim(&config, &bus));
+    test_done_queue = xQueueCreate(4, sizeof(onewire_bus_request_t *));
+    TEST_ASSERT_NOT_NULL(test_done_queue);
+
+    uint8_t tx[4][10];
+    uint8_t scratchpads[4][9];
+    onewire_bus_request_t requests[4];
+    for (size_t i = 0; i < 4; i ++) {
+        tx[i][0] = ONEWIRE_CMD_MATCH_ROM;
+        TEST_ESP_OK(onewire_sim_get_rom_number(bus, i, &tx[i][1]));
+        tx[i][9] = TEST_CMD_READ_SCRATCHPAD;
+        requests[i] = (onewire_bus_request_t) {
+            .tx_data = tx[i],
+            .tx_data_size = sizeof(tx[i]),
+            .rx_data = scratchpads[i],
+            .rx_data_size = sizeof(scratchpads[i]),
+            .on_done = test_request_done,
+        };
+    }
+    for (size_t i = 0; i < 4; i ++) {
+        TEST_ESP_OK(onewire_bus_submit(bus, &requests[i]));
+    }
+
+    for (size_t i = 0; i < 4; i ++) {
+        onewire_bus_request_t *request = NULL;
+        TEST_ASSERT_TRUE(xQueueReceive(test_done_queue, &request, pdMS_TO_TICKS(1000)) == pdPASS);
+        TEST_ASSERT_TRUE(request == &requests[i]);
+        TEST_ESP_OK((esp_err_t)(intptr_t)request->user_ctx);
+        TEST_ASSERT_TRUE(request->rx_crc_valid);
+        TEST_ASSERT_EQUAL_INT16(TEST_POWER_ON_RAW_TEMPERATURE, (int16_t)(scratchpads[i][0] | scratchpads[i][1] << 8));
+    }
+
+    TEST_ESP_OK(onewire_del_bus(bus));
+    vQueueDelete(test_done_queue);
+
+    // a bus installed without request queue only serves blocking calls
+    bus = test_new_bus(1);
+    TEST_ASSERT_EQUAL(ESP_ERR_INVALID_STATE, onewire_bus_submit(bus, &requests[0]));
+    TEST_ESP_OK(onewire_del_bus(bus));
+}
+
+TEST_CASE("injected CRC error fails scratchpad CRC", "[onewire_sim]")
+{
+    onewire_bus_handle_t bus = test_new_bus(2);
+    uint8_t rom_numbers[2][8];
+    uint8_t scratchpad[9];
+    bool crc_valid = false;
+
+    TEST_ESP_OK(onewire_sim_get_rom_number(bus, 0, rom_numbers[0]));
+    TEST_ESP_OK(onewire_sim_get_rom_number(bus, 1, rom_numbers[1]));
+    TEST_ESP_OK(onewire_sim_inject_fault(bus, 1, ONEWIRE_SIM_FAULT_CRC_ERROR, 2));
+
+    for (int read = 0; read < 2; read ++) {
+        TEST_ESP_OK(test_read_scratchpad(bus, rom_numbers[1], scratchpad, &crc_valid));
+        TEST_ASSERT_FALSE(crc_valid);
+        TEST_ESP_OK(test_read_scratchpad(bus, rom_numbers[0], scratchpad, &crc_valid));
+        TEST_ASSERT_TRUE(crc_valid); // other devices are not affected
+    }
+    TEST_ESP_OK(test_read_scratchpad(bus, rom_numbers[1], scratchpad, &crc_valid));
+    TEST_ASSERT_TRUE(crc_valid);
+
+    TEST_ESP_OK(onewire_del_bus(bus));
+}
+
+TEST_CASE("injected missing presence hides device", "[onewire_sim]")
+{
+    onewire_bus_handle_t bus = test_new_bus(2);
+    uint8_t rom_numbers[2][8];
+    uint8_t rom_number[8];
+
+    // bus without any presence pulse reports no device
+    TEST_ESP_OK(onewire_sim_inject_fault(bus, 0, ONEWIRE_SIM_FAULT_NO_PRESENCE, 1));
+    TEST_ESP_OK(onewire_sim_inject_fault(bus, 1, ONEWIRE_SIM_FAULT_NO_PRESENCE, 1));
+    TEST_ASSERT_EQUAL(ESP_ERR_NOT_FOUND, onewire_bus_reset(bus));
+    TEST_ESP_OK(onewire_bus_reset(bus));
+
+    // device that missed the reset does not take part in the search after it
+    TEST_ESP_OK(onewire_sim_inject_fault(bus, 0, ONEWIRE_SIM_FAULT_NO_PRESENCE, 1));
+    TEST_ASSERT_EQUAL(1, test_search(bus, rom_numbers, 2));
+    TEST_ESP_OK(onewire_sim_get_rom_number(bus, 1, rom_number));
+    TEST_ASSERT_EQUAL_MEMORY(rom_number, rom_numbers[0], 8);
+
+    TEST_ASSERT_EQUAL(2, test_search(bus, rom_numbers, 2));
+
+    TEST_ESP_OK(onewire_del_bus(bus));
+}
+
+void app_main(void)
+{
+    UNITY_BEGIN();
+    unity_run_all_tests();
+    exit(UNITY_END() ? 1 : 0);
+}
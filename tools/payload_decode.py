@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+"""Decode packed binary payloads published by ESP32_WiFi_OneWire_MQTT, see main/include/packed.h.
+
+Each argument is a file holding one message, or with --hex a message in hexadecimal. Without arguments
+one message is read from stdin, e.g.
+    mosquitto_sub -t ESP32_WIFI_ONEWIRE_MQTT/temperature/batch -C 1 | tools/payload_decode.py
+Records are printed as JSON lines.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+PACKED_VERSION = 1
+HEADER = struct.Struct("<BB")
+RECORD = struct.Struct("<8sBBhIq")
+
+
+def decode(payload):
+    if len(payload) < HEADER.size:
+        raise ValueError("payload of %d bytes is shorter than the header" % len(payload))
+    version, count = HEADER.unpack_from(payload)
+    if version != PACKED_VERSION:
+        raise ValueError("unknown payload version %d" % version)
+    if len(payload) != HEADER.size + count * RECORD.size:
+        raise ValueError("payload of %d bytes does not hold %d records" % (len(payload), count))
+
+    records = []
+    for offset in range(HEADER.size, len(payload), RECORD.size):
+        rom_id, device, resolution, temperature, uptime_ms, time_ms = RECORD.unpack_from(payload, offset)
+        record = {
+            "device": device,
+            "temperature": temperature / 16,
+        }
+        if any(rom_id):
+            record["rom_id"] = rom_id.hex().upper()  # as printed by the firmware, family code first
+        if resolution:
+            record["resolution"] = resolution
+        if uptime_ms:
+            record["uptime_ms"] = uptime_ms
+        if time_ms:
+            record["time_ms"] = time_ms
+        records.append(record)
+    return records
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--hex", action="store_true", help="arguments are messages in hexadecimal")
+    parser.add_argument("messages", nargs="*", help="files with one message each, or hexadecimal with --hex")
+    args = parser.parse_args()
+
+    if not args.messages:
+        payloads = [sys.stdin.buffer.read()]
+    elif args.hex:
+        payloads = [bytes.fromhex(message) for message in args.messages]
+    else:
+        payloads = []
+        for path in args.messages:
+            with open(path, "rb") as file:
+                payloads.append(file.read())
+
+    status = 0
+    for payload in payloads:
+        try:
+            for record in decode(payload):
+                print(json.dumps(record))
+        except ValueError as error:
+            print("error: %s" % error, file=sys.stderr)
+            status = 1
+    return status
+
+
+if __name__ == "__main__":
+    sys.exit(main())